@@ -0,0 +1,72 @@
+/*
+ * apex_btb.cpp
+ * Contains the branch target buffer: config.btb_sets sets of
+ * config.btb_ways entries, indexed by the low bits of the instruction
+ * number (pc / 4) and tagged with the full pc. Each entry keeps the last
+ * outcome of its branch and the taken target. Replacement is least
+ * recently used, counted in lookups and updates rather than cycles so the
+ * functional interpreter can train it too.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+static BTB_Entry *
+btb_set(APEX_CPU *cpu, int pc)
+{
+    int set = (pc / 4) & (cpu->config.btb_sets - 1);
+
+    return &cpu->btb[set * cpu->config.btb_ways];
+}
+
+/* Returns the entry for the branch at pc, or NULL on a miss */
+BTB_Entry *
+APEX_btb_lookup(APEX_CPU *cpu, int pc)
+{
+    BTB_Entry *set = btb_set(cpu, pc);
+
+    for (int way = 0; way < cpu->config.btb_ways; ++way)
+    {
+        if (set[way].valid && set[way].tag == pc)
+        {
+            set[way].last_use = ++cpu->btb_stamp;
+            return &set[way];
+        }
+    }
+    return NULL;
+}
+
+/* Records a resolved branch, allocating over the least recently used way */
+void
+APEX_btb_update(APEX_CPU *cpu, int pc, int taken, int target)
+{
+    BTB_Entry *set = btb_set(cpu, pc);
+    BTB_Entry *entry = NULL;
+
+    for (int way = 0; way < cpu->config.btb_ways; ++way)
+    {
+        if (set[way].valid && set[way].tag == pc)
+        {
+            entry = &set[way];
+            break;
+        }
+        if (!entry || (entry->valid && (!set[way].valid || set[way].last_use < entry->last_use)))
+        {
+            entry = &set[way];
+        }
+    }
+
+    entry->valid = TRUE;
+    entry->tag = pc;
+    entry->outcome = taken;
+    entry->target = target;
+    entry->last_use = ++cpu->btb_stamp;
+}
+
+int
+APEX_btb_entries(const APEX_Config *config)
+{
+    return config->btb_sets * config->btb_ways;
+}
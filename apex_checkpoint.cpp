@@ -0,0 +1,288 @@
+/*
+ * apex_checkpoint.cpp
+ * Contains binary checkpoint save/restore of the complete simulated state of
+ * an APEX_CPU: registers, rename state and branch checkpoints, IQ, ROB,
+ * LSQ, store buffer, BTB, branch predictor, pipeline latches, data memory
+ * and clock.
+ *
+ * A checkpoint can only be restored into a CPU built from the same program
+ * with the same APEX_Config; both are recorded in the header and checked.
+ * Session settings (batch mode, trace, cycle limit, pending commands) are
+ * not part of the state and are left alone by a restore. The format is the
+ * host's native layout, so checkpoints are not portable between builds.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#define CHECKPOINT_MAGIC "APEXCKP1"
+
+/* One routine walks the state for both directions so they cannot drift */
+typedef struct Ckpt_Stream
+{
+    std::vector<uint8_t> *out; /* Saving when set */
+    const uint8_t *in;         /* Otherwise restoring from here */
+    size_t in_size;
+    size_t pos;
+    int error;
+} Ckpt_Stream;
+
+static void
+ckpt_bytes(Ckpt_Stream *s, void *data, size_t n)
+{
+    if (s->out)
+    {
+        const uint8_t *p = (const uint8_t *)data;
+
+        s->out->insert(s->out->end(), p, p + n);
+        return;
+    }
+
+    if (s->error || n > s->in_size - s->pos)
+    {
+        s->error = TRUE;
+        return;
+    }
+    memcpy(data, s->in + s->pos, n);
+    s->pos += n;
+}
+
+#define CKPT(s, field) ckpt_bytes((s), &(field), sizeof(field))
+
+/* Identifies the program so a checkpoint is not restored onto another one */
+static uint32_t
+code_hash(const APEX_CPU *cpu)
+{
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < cpu->code_memory_size; ++i)
+    {
+        const APEX_Instruction *ins = &cpu->code_memory[i];
+        int fields[5] = {ins->opcode, ins->rd, ins->rs1, ins->rs2, ins->imm};
+
+        for (int f = 0; f < 5; ++f)
+        {
+            hash = (hash ^ (uint32_t)fields[f]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static void
+ckpt_header(Ckpt_Stream *s, APEX_CPU *cpu)
+{
+    char magic[8];
+    APEX_Config config = cpu->config;
+    int code_size = cpu->code_memory_size;
+    uint32_t hash = code_hash(cpu);
+
+    memcpy(magic, CHECKPOINT_MAGIC, sizeof(magic));
+    CKPT(s, magic);
+    CKPT(s, config);
+    CKPT(s, code_size);
+    CKPT(s, hash);
+
+    if (s->out || s->error)
+    {
+        return;
+    }
+    if (memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0)
+    {
+        fprintf(stderr, "APEX_Error: not an APEX checkpoint\n");
+        s->error = TRUE;
+    }
+    else if (memcmp(&config, &cpu->config, sizeof(config)) != 0)
+    {
+        fprintf(stderr, "APEX_Error: checkpoint was taken with a different config\n");
+        s->error = TRUE;
+    }
+    else if (code_size != cpu->code_memory_size || hash != code_hash(cpu))
+    {
+        fprintf(stderr, "APEX_Error: checkpoint was taken with a different program\n");
+        s->error = TRUE;
+    }
+}
+
+static void
+ckpt_state(Ckpt_Stream *s, APEX_CPU *cpu)
+{
+    const APEX_Config *config = &cpu->config;
+    CPU_Stage *latches[] = {
+        &cpu->fetch,     &cpu->branch_exec, &cpu->memory, &cpu->commitment,
+        &cpu->branch_wb, &cpu->mem_wb,
+    };
+
+    ckpt_header(s, cpu);
+    if (s->error)
+    {
+        return;
+    }
+
+    CKPT(s, cpu->pc);
+    CKPT(s, cpu->clock);
+    CKPT(s, cpu->insn_completed);
+    CKPT(s, cpu->halted);
+    CKPT(s, cpu->ffwd_insns);
+    CKPT(s, cpu->commit_stats);
+    CKPT(s, cpu->branch_stats);
+    CKPT(s, cpu->lsq_stats);
+    CKPT(s, cpu->zero_flag);
+    CKPT(s, cpu->positive_flag);
+    CKPT(s, cpu->fetch_from_next_cycle);
+    CKPT(s, cpu->dispatch_seq);
+    CKPT(s, cpu->arch_regs);
+    ckpt_bytes(s, cpu->phys_regs, config->phys_reg_file_size * sizeof(RF_Entry));
+    CKPT(s, cpu->data_memory);
+    ckpt_bytes(s, cpu->btb, APEX_btb_entries(config) * sizeof(BTB_Entry));
+    CKPT(s, cpu->btb_stamp);
+    ckpt_bytes(s, cpu->pred_table, APEX_predictor_entries(config) * sizeof(int16_t));
+    CKPT(s, cpu->branch_history);
+    CKPT(s, cpu->ras);
+    CKPT(s, cpu->ras_top);
+    ckpt_bytes(s, cpu->itc, config->itc_size * sizeof(ITC_Entry));
+    CKPT(s, cpu->path_history);
+    CKPT(s, cpu->rename_table);
+
+    for (size_t i = 0; i < sizeof(latches) / sizeof(latches[0]); ++i)
+    {
+        ckpt_bytes(s, latches[i], sizeof(CPU_Stage));
+    }
+    CKPT(s, cpu->decode1);
+    CKPT(s, cpu->decode2);
+    CKPT(s, cpu->mult_exec);
+    CKPT(s, cpu->int_exec);
+    CKPT(s, cpu->mult_wb);
+    CKPT(s, cpu->int_wb);
+
+    /* Free list and the wakeup lists hanging off each physical register,
+       IQ slots and WAKEUP_LSQ() STOREs alike */
+    ckpt_bytes(s, cpu->free_list, cpu->free_words * sizeof(uint64_t));
+    CKPT(s, cpu->free_count);
+    ckpt_bytes(s, cpu->branch_ckpt, config->branch_checkpoints * sizeof(Branch_Checkpoint));
+    ckpt_bytes(s, cpu->branch_ckpt_free,
+               config->branch_checkpoints * cpu->free_words * sizeof(uint64_t));
+    CKPT(s, cpu->branch_ckpt_live);
+    for (int p = 0; p < config->phys_reg_file_size && !s->error; ++p)
+    {
+        int waiting = cpu->wakeup[p].size();
+
+        CKPT(s, waiting);
+        if (!s->out)
+        {
+            if (waiting < 0 || (size_t)waiting * sizeof(int) > s->in_size - s->pos)
+            {
+                s->error = TRUE;
+                break;
+            }
+            cpu->wakeup[p].resize(waiting);
+        }
+        if (waiting)
+        {
+            ckpt_bytes(s, cpu->wakeup[p].data(), waiting * sizeof(int));
+        }
+    }
+
+    /* Issue queue and its select bitmasks */
+    ckpt_bytes(s, cpu->iq, config->iq_size * sizeof(IQ_Entry));
+    CKPT(s, cpu->iq_valid);
+    CKPT(s, cpu->iq_ready);
+    CKPT(s, cpu->iq_fu_mask);
+    CKPT(s, cpu->iq_older);
+
+    /* ROB ring, stored whole so head/tail keep their meaning */
+    ckpt_bytes(s, cpu->rob, config->rob_size * sizeof(ROB_Entry));
+    CKPT(s, cpu->rob_head);
+    CKPT(s, cpu->rob_tail);
+    CKPT(s, cpu->rob_count);
+
+    /* LSQ ring, likewise */
+    ckpt_bytes(s, cpu->lsq, config->lsq_size * sizeof(LSQ_Entry));
+    CKPT(s, cpu->lsq_head);
+    CKPT(s, cpu->lsq_tail);
+    CKPT(s, cpu->lsq_count);
+
+    /* Store buffer ring */
+    ckpt_bytes(s, cpu->store_buffer, config->store_buffer_size * sizeof(Store_Buffer_Entry));
+    CKPT(s, cpu->sb_head);
+    CKPT(s, cpu->sb_tail);
+    CKPT(s, cpu->sb_count);
+}
+
+/* Appends the CPU state to buf */
+void
+APEX_checkpoint_save(const APEX_CPU *cpu, std::vector<uint8_t> &buf)
+{
+    Ckpt_Stream s = {&buf, NULL, 0, 0, FALSE};
+
+    ckpt_state(&s, (APEX_CPU *)cpu);
+}
+
+/*
+ * Restores a state saved by APEX_checkpoint_save(). Returns -1 if buf is not
+ * a checkpoint of this program and config, or is truncated; the CPU is then
+ * left partially restored and should be discarded.
+ */
+int
+APEX_checkpoint_restore(APEX_CPU *cpu, const std::vector<uint8_t> &buf)
+{
+    Ckpt_Stream s = {NULL, buf.data(), buf.size(), 0, FALSE};
+
+    ckpt_state(&s, cpu);
+    if (s.error || s.pos != buf.size())
+    {
+        fprintf(stderr, "APEX_Error: Unable to restore checkpoint\n");
+        return -1;
+    }
+    return 0;
+}
+
+int
+APEX_checkpoint_write(const APEX_CPU *cpu, const char *filename)
+{
+    std::vector<uint8_t> buf;
+    FILE *fp;
+    size_t written;
+
+    APEX_checkpoint_save(cpu, buf);
+
+    fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open checkpoint %s\n", filename);
+        return -1;
+    }
+    written = fwrite(buf.data(), 1, buf.size(), fp);
+    if (fclose(fp) != 0 || written != buf.size())
+    {
+        fprintf(stderr, "APEX_Error: Unable to write checkpoint %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+int
+APEX_checkpoint_read(APEX_CPU *cpu, const char *filename)
+{
+    std::vector<uint8_t> buf;
+    uint8_t chunk[4096];
+    size_t n;
+    FILE *fp;
+
+    fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open checkpoint %s\n", filename);
+        return -1;
+    }
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    {
+        buf.insert(buf.end(), chunk, chunk + n);
+    }
+    fclose(fp);
+
+    return APEX_checkpoint_restore(cpu, buf);
+}
@@ -0,0 +1,275 @@
+/*
+ * apex_config.cpp
+ * Contains the APEX cpu microarchitecture configuration: defaults, the
+ * "key = value" config file reader and validation.
+ */
+#include <ctype.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+typedef struct Config_Key
+{
+    const char *name;
+    size_t offset;
+    int min;
+    int max;
+    const char *(*value_name)(int); /* Names the values of an enumerated key */
+} Config_Key;
+
+static const Config_Key config_keys[] = {
+    {"iq_size", offsetof(APEX_Config, iq_size), 1, MAX_IQ_SIZE},
+    {"rob_size", offsetof(APEX_Config, rob_size), 1, 65536},
+    {"lsq_size", offsetof(APEX_Config, lsq_size), 1, 65536},
+    {"store_buffer_size", offsetof(APEX_Config, store_buffer_size), 1, 65536},
+    /* A mapping for every architectural register and the flags, plus one to rename into */
+    {"phys_regs", offsetof(APEX_Config, phys_reg_file_size), REG_FILE_SIZE + 2, MAX_PHYS_REG_FILE_SIZE},
+    {"fetch_width", offsetof(APEX_Config, fetch_width), 1, MAX_FETCH_WIDTH},
+    {"mul_units", offsetof(APEX_Config, mul_units), 1, MAX_FU_UNITS},
+    {"mul_latency", offsetof(APEX_Config, mul_latency), 1, MAX_MUL_LATENCY},
+    {"mul_pipelined", offsetof(APEX_Config, mul_pipelined), 0, 1},
+    {"int_units", offsetof(APEX_Config, int_units), 1, MAX_FU_UNITS},
+    {"issue_width", offsetof(APEX_Config, issue_width), 1, MAX_ISSUE_WIDTH},
+    {"commit_width", offsetof(APEX_Config, commit_width), 1, MAX_COMMIT_WIDTH},
+    {"btb_sets", offsetof(APEX_Config, btb_sets), 1, MAX_BTB_SETS},
+    {"btb_ways", offsetof(APEX_Config, btb_ways), 1, MAX_BTB_WAYS},
+    {"predictor", offsetof(APEX_Config, predictor), 0, NUM_PREDICTORS - 1, APEX_predictor_name},
+    {"pred_table_bits", offsetof(APEX_Config, pred_table_bits), 1, MAX_PRED_TABLE_BITS},
+    {"pred_history", offsetof(APEX_Config, pred_history), 1, MAX_PRED_HISTORY},
+    {"itc_size", offsetof(APEX_Config, itc_size), 1, MAX_ITC_SIZE},
+    {"itc_history", offsetof(APEX_Config, itc_history), 0, MAX_PRED_HISTORY},
+    {"ras_size", offsetof(APEX_Config, ras_size), 1, MAX_RAS_SIZE},
+    {"branch_checkpoints", offsetof(APEX_Config, branch_checkpoints), 1, MAX_BRANCH_CHECKPOINTS},
+};
+
+#define NUM_CONFIG_KEYS (sizeof(config_keys) / sizeof(config_keys[0]))
+
+static int *
+config_field(APEX_Config *config, const Config_Key *key)
+{
+    return (int *)((char *)config + key->offset);
+}
+
+void
+APEX_config_default(APEX_Config *config)
+{
+    config->iq_size = IQ_SIZE;
+    config->rob_size = ROB_SIZE;
+    config->lsq_size = LSQ_SIZE;
+    config->store_buffer_size = STORE_BUFFER_SIZE;
+    config->phys_reg_file_size = PHYS_REG_FILE_SIZE;
+    config->fetch_width = FETCH_WIDTH;
+    config->mul_units = MUL_UNITS;
+    config->mul_latency = MUL_LATENCY;
+    config->mul_pipelined = FALSE;
+    config->int_units = INT_UNITS;
+    config->issue_width = ISSUE_WIDTH;
+    config->commit_width = COMMIT_WIDTH;
+    config->btb_sets = BTB_SETS;
+    config->btb_ways = BTB_WAYS;
+    config->predictor = PREDICTOR;
+    config->pred_table_bits = PRED_TABLE_BITS;
+    config->pred_history = PRED_HISTORY;
+    config->itc_size = ITC_SIZE;
+    config->itc_history = ITC_HISTORY;
+    config->ras_size = RAS_SIZE;
+    config->branch_checkpoints = BRANCH_CHECKPOINTS;
+}
+
+/*
+ * Sets one parameter by name. Enumerated keys also take the value's name.
+ * Returns 0 on success, -1 for an unknown key and -2 for a value that is
+ * not a number in the allowed range.
+ */
+int
+APEX_config_set(APEX_Config *config, const char *key, const char *value)
+{
+    for (size_t i = 0; i < NUM_CONFIG_KEYS; ++i)
+    {
+        char *end;
+        long v;
+
+        if (strcmp(config_keys[i].name, key) != 0)
+        {
+            continue;
+        }
+
+        for (int n = config_keys[i].min; config_keys[i].value_name && n <= config_keys[i].max; ++n)
+        {
+            if (strcmp(config_keys[i].value_name(n), value) == 0)
+            {
+                *config_field(config, &config_keys[i]) = n;
+                return 0;
+            }
+        }
+
+        v = strtol(value, &end, 10);
+        if (end == value || *end != '\0' || v < config_keys[i].min ||
+            v > config_keys[i].max)
+        {
+            return -2;
+        }
+        *config_field(config, &config_keys[i]) = (int)v;
+        return 0;
+    }
+    return -1;
+}
+
+static char *
+trim(char *s)
+{
+    char *end;
+
+    while (isspace((unsigned char)*s))
+    {
+        s++;
+    }
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+    {
+        *--end = '\0';
+    }
+    return s;
+}
+
+/*
+ * Reads "key = value" lines, '#' starts a comment. Returns 0 on success,
+ * otherwise reports the offending line on stderr and returns -1.
+ */
+int
+APEX_config_load(APEX_Config *config, const char *filename)
+{
+    FILE *fp;
+    char line[256];
+    int line_num = 0;
+    int ret = 0;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open config file %s\n", filename);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        char *comment, *eq, *key, *value;
+
+        line_num++;
+        comment = strchr(line, '#');
+        if (comment)
+        {
+            *comment = '\0';
+        }
+
+        key = trim(line);
+        if (*key == '\0')
+        {
+            continue;
+        }
+
+        eq = strchr(key, '=');
+        if (!eq)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: expected key = value\n", filename, line_num);
+            ret = -1;
+            continue;
+        }
+        *eq = '\0';
+        value = trim(eq + 1);
+        key = trim(key);
+
+        switch (APEX_config_set(config, key, value))
+        {
+            case -1:
+                fprintf(stderr, "APEX_Error: %s:%d: unknown key %s\n", filename, line_num, key);
+                ret = -1;
+                break;
+            case -2:
+                fprintf(stderr, "APEX_Error: %s:%d: bad value for %s\n", filename, line_num, key);
+                ret = -1;
+                break;
+        }
+    }
+
+    fclose(fp);
+    return ret;
+}
+
+/* Checks combinations the per-key ranges cannot express */
+int
+APEX_config_validate(const APEX_Config *config)
+{
+    for (size_t i = 0; i < NUM_CONFIG_KEYS; ++i)
+    {
+        int v = *config_field((APEX_Config *)config, &config_keys[i]);
+
+        if (v < config_keys[i].min || v > config_keys[i].max)
+        {
+            fprintf(stderr, "APEX_Error: %s must be between %d and %d\n",
+                    config_keys[i].name, config_keys[i].min, config_keys[i].max);
+            return -1;
+        }
+    }
+    if (config->btb_sets & (config->btb_sets - 1))
+    {
+        fprintf(stderr, "APEX_Error: btb_sets must be a power of two\n");
+        return -1;
+    }
+    if (config->itc_size & (config->itc_size - 1))
+    {
+        fprintf(stderr, "APEX_Error: itc_size must be a power of two\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void
+print_value(const APEX_Config *config, const Config_Key *key, FILE *out)
+{
+    int v = *config_field((APEX_Config *)config, key);
+
+    if (key->value_name)
+    {
+        fprintf(out, "%s", key->value_name(v));
+    }
+    else
+    {
+        fprintf(out, "%d", v);
+    }
+}
+
+void
+APEX_config_print(const APEX_Config *config, FILE *out)
+{
+    for (size_t i = 0; i < NUM_CONFIG_KEYS; ++i)
+    {
+        fprintf(out, "%s = ", config_keys[i].name);
+        print_value(config, &config_keys[i], out);
+        fprintf(out, "\n");
+    }
+}
+
+/* Config columns for result tables, matching APEX_config_csv_row() */
+void
+APEX_config_csv_header(FILE *out)
+{
+    for (size_t i = 0; i < NUM_CONFIG_KEYS; ++i)
+    {
+        fprintf(out, "%s%s", i ? "," : "", config_keys[i].name);
+    }
+}
+
+void
+APEX_config_csv_row(const APEX_Config *config, FILE *out)
+{
+    for (size_t i = 0; i < NUM_CONFIG_KEYS; ++i)
+    {
+        fprintf(out, "%s", i ? "," : "");
+        print_value(config, &config_keys[i], out);
+    }
+}
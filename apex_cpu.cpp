@@ -8,14 +8,16 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <sstream>
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
+#include "apex_trace.h"
 
-int display_state = FALSE;
-FILE * fp;
+static void APEX_run_actions(APEX_CPU *cpu);
 /* Converts the PC(4000 series) into array index for code memory
  *
  * Note: You are not supposed to edit this function
@@ -26,6 +28,17 @@ get_code_memory_index_from_pc(const int pc)
     return (pc - 4000) / 4;
 }
 
+/* CPU time of the calling thread, so instances sharing a process each
+ * measure only their own simulation */
+static double
+host_time()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 /* Debug function which prints the register file
  *
  * Note: You are not supposed to edit this function
@@ -43,7 +56,7 @@ get_code_memory_index_from_pc(const int pc)
        if (cpu->arch_regs[i].value == 0 && cpu->arch_regs[i].src_bit == 0) {
          printf("R%-3d[X] ",i);
        } else {
-             printf("R%-3d[%-3d] ", i, cpu->arch_regs[i]);
+             printf("R%-3d[%-3d] ", i, cpu->arch_regs[i].value);
        }
 
      }
@@ -55,7 +68,7 @@ get_code_memory_index_from_pc(const int pc)
        if (cpu->arch_regs[i].value == 0 && cpu->arch_regs[i].src_bit == 0) {
          printf("R%-3d[X] ",i);
        } else {
-             printf("R%-3d[%-3d] ", i, cpu->arch_regs[i]);
+             printf("R%-3d[%-3d] ", i, cpu->arch_regs[i].value);
        }
      }
 
@@ -69,25 +82,25 @@ get_code_memory_index_from_pc(const int pc)
 
      printf("\n----------\n%s\n----------\n", "Physical Registers:");
 
-     for (int i = 0; i < 20 / 2; ++i)
+     for (int i = 0; i < cpu->config.phys_reg_file_size / 2; ++i)
      {
        if (cpu->phys_regs[i].value == 0 &&
          cpu->phys_regs[i].src_bit == 0) {
          printf("R%-3d[X] ",i);
        } else {
-             printf("R%-3d[%-3d] ", i, cpu->phys_regs[i]);
+             printf("R%-3d[%-3d] ", i, cpu->phys_regs[i].value);
        }
      }
 
      printf("\n");
 
-     for (int i = (20 / 2); i < 20; ++i)
+     for (int i = (cpu->config.phys_reg_file_size / 2); i < cpu->config.phys_reg_file_size; ++i)
      {
        if (cpu->phys_regs[i].value == 0
          && cpu->phys_regs[i].src_bit == 0) {
          printf("R%-3d[X] ",i);
        } else {
-             printf("R%-3d[%-3d] ", i, cpu->phys_regs[i]);
+             printf("R%-3d[%-3d] ", i, cpu->phys_regs[i].value);
        }
      }
 
@@ -104,7 +117,7 @@ print_rename_table(const APEX_CPU *cpu)
 
     for (int i = 0; i < REG_FILE_SIZE / 2; ++i)
     {
-        printf("R%-3d[P%-3d] ", i, cpu->rename_table[i].phys_reg_id);
+        printf("R%-3d[P%-3d] ", i, cpu->rename_table.phys[i]);
     }
 
     printf("\n");
@@ -142,7 +155,7 @@ static void
 print_iq(const APEX_CPU *cpu)
 {
   printf("\n----------\n%s\n----------\n", "IQ:");
-  for (int i = 0; i < 8; i++)
+  for (int i = 0; i < cpu->config.iq_size; i++)
   {
     printf("ENTRY %d || ", i);
     printf("   %d    \n", cpu->iq[i].opcode );
@@ -206,8 +219,11 @@ print_rob(const APEX_CPU *cpu)
 {
   int i = 0;
   printf("\n----------\n%s\n----------\n", "ROB:");
-    for (auto it = cpu->rob->begin(); it != cpu->rob->end(); it++)
+    for (int n = 0, id = cpu->rob_head; n < cpu->rob_count;
+         n++, id = (id + 1) % cpu->config.rob_size)
     {
+      const ROB_Entry *it = &cpu->rob[id];
+
       printf("ENTRY %d ||", i);
       if (it->pc_value < 4000) {
         printf("XX, ");
@@ -255,84 +271,85 @@ print_rob(const APEX_CPU *cpu)
 static void
 print_lsq(APEX_CPU *cpu)
 {
+  int i = 0;
   printf("\n----------\n%s\n----------\n", "LSQ:");
+    for (int n = 0, id = cpu->lsq_head; n < cpu->lsq_count;
+         n++, id = (id + 1) % cpu->config.lsq_size)
+    {
+      const LSQ_Entry *it = &cpu->lsq[id];
 
-  for (int i = 0; i < cpu->lsq->size(); i++) {
-
-      printf("ENTRY %d || ", i);
-        if (cpu->iq[i].status_bit != 0 || cpu->iq[i].status_bit != 1 &&
-          (cpu->iq[i].fu_type <0) || (cpu->iq[i].fu_type > 3)) {
-          printf("XX, ");
-          printf("XX, ");
-        } else {
-            printf("%d, ", cpu->iq[i].status_bit);
-            printf("%d, ", cpu->iq[i].fu_type);
-        }
-
-        if (cpu->iq[i].src1_rdy_bit == NOT_READY &&
-          cpu->iq[i].fu_type <=0)
-        {
-          printf("XX, ");
-        } else printf("%d, ", cpu->iq[i].src1_rdy_bit);
-
-        if ((cpu->iq[i].src1_rdy_bit == NOT_READY ||
-          cpu->iq[i].src1_tag ==-1 ))
-        {
-          printf("XX, "); //tag
-          printf("XX, "); //val
-        }else {
-          printf("%d, ", cpu->iq[i].src1_tag);
-          printf("%d, ", cpu->iq[i].src1_val);
-        }
-
-        if (cpu->iq[i].src2_rdy_bit == NOT_READY &&
-          cpu->iq[i].fu_type <=0)
-          {
-          printf("XX, ");
+      printf("ENTRY %d || %d, %s, ", i, it->pc, APEX_opcode_name(it->opcode));
+      if (it->addr_known) {
+        printf("%d, ", it->address);
+      } else printf("XX, ");
 
-        } else printf("%d, ", cpu->iq[i].src2_rdy_bit);
-
-          if ((cpu->iq[i].src2_rdy_bit == NOT_READY ||
-            cpu->iq[i].src2_tag ==-1 ))
-          {
-              printf("XX, "); //tag
-              printf("XX, "); //val
-          }else {
-              printf("%d, ", cpu->iq[i].src2_tag);
-              printf("%d, ", cpu->iq[i].src2_val);
-          }
-        if (cpu->iq[i].dest == INVALID) {
-          printf("XX ");
-        } else printf("%d ", cpu->iq[i].dest);
-        printf("\n");
+      //STOREs show their data or the register it comes from, LOADs their destination
+      if (it->opcode == OPCODE_STORE) {
+        if (it->data_known) printf("%d, ", it->data);
+        else if (it->data_tag != -1) printf("P%d?, ", it->data_tag);
+        else printf("XX, ");
+      } else printf("P%d, ", it->dest);
 
-      }
+      printf("%d\n", it->issued);
+      ++i;
+    }
 
-      printf("\n");
+    printf("Store buffer:\n");
+    for (int n = 0, id = cpu->sb_head; n < cpu->sb_count;
+         n++, id = (id + 1) % cpu->config.store_buffer_size)
+    {
+      const Store_Buffer_Entry *it = &cpu->store_buffer[id];
 
+      printf("ENTRY %d || %d, MEM[%d] = %d\n", n, it->pc, it->address, it->data);
     }
 
+    printf("\n");
+}
+
 static void
 print_btb(APEX_CPU *cpu)
 {
   printf("\n----------\n%s\n----------\n", "BTB:");
 
-  for (int i = 0; i < 4; i++){
-    printf("ENTRY %d ||", i);
-    if (!cpu->btb[i].valid)
-    {
-
-      printf("XX, ");
+  for (int i = 0; i < APEX_btb_entries(&cpu->config); i++){
+    const BTB_Entry *entry = &cpu->btb[i];
 
-    } else printf("%d ", cpu->btb[i].valid);
+    if (!entry->valid)
+    {
+      continue;
+    }
+    printf("SET %d WAY %d || pc %d outcome %d target %d\n", i / cpu->config.btb_ways,
+           i % cpu->config.btb_ways, entry->tag, entry->outcome, entry->target);
+  } printf("\n");
+}
 
-    if (!cpu->btb[i].outcome)
+/* Drops everything fetched but not yet dispatched (decode1 and decode2 groups) */
+static void
+flush_front_end(APEX_CPU *cpu)
+{
+    for (int slot = 0; slot < MAX_FETCH_WIDTH; slot++)
     {
-      printf("XX ");
-    } else printf("%d ", cpu->btb[i].outcome);
+        cpu->decode1[slot].has_insn = FALSE;
+        cpu->decode2[slot].has_insn = FALSE;
+    }
+}
 
-    printf("\n");
-  } printf("\n");
+/*
+ * The JUMP/JALR/RET in the branch unit was fetched down the wrong target:
+ * fetch again from the real one. Its checkpoint puts the return stack back
+ * as that transfer left it.
+ */
+static void
+indirect_mispredict(APEX_CPU *cpu, int target)
+{
+    cpu->pc = target;
+    cpu->fetch_from_next_cycle = TRUE;
+    flush_front_end(cpu);
+    cpu->fetch.has_insn = TRUE;
+
+    cpu->branch_stats.flush_cycles += cpu->clock - cpu->branch_exec.fetch_cycle;
+    APEX_TRACE(cpu, TRACE_EXEC, TRACE_LEVEL_DETAIL, "Branch Exec: %s mispredict pc %d, fetch redirected to %d\n",
+               APEX_opcode_name(cpu->branch_exec.opcode), cpu->branch_exec.pc, target);
 }
 
 /*
@@ -344,6 +361,7 @@ static void
 APEX_fetch(APEX_CPU *cpu)
 {
     APEX_Instruction *current_ins;
+    int target = 0;
     if (cpu->fetch.has_insn == TRUE && cpu->fetch.stall == FALSE)
     {
         /* This fetches new branch target instruction from next cycle */
@@ -355,155 +373,366 @@ APEX_fetch(APEX_CPU *cpu)
             return;
         }
 
-        /* Store current PC in fetch latch */
-        cpu->fetch.pc = cpu->pc;
-
-        /* Index into code memory using this pc and copy all instruction fields
-         * into fetch latch  */
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-        cpu->fetch.opcode = current_ins->opcode;
-
-        switch (cpu->fetch.opcode){
-            case OPCODE_MUL:
-                cpu->fetch.vfu = MUL_VFU;
-                break;
-
-            case OPCODE_ADD:
-            case OPCODE_ADDL:
-            case OPCODE_SUB:
-            case OPCODE_SUBL:
-            case OPCODE_MOVC:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_EXOR:
-            case OPCODE_LOAD:
-            case OPCODE_STORE:
-            case OPCODE_NOP:
-            case OPCODE_CMP:
-                cpu->fetch.vfu = INT_VFU;
+        /* Up to fetch_width sequential instructions, into decode1 slots */
+        for (int slot = 0; slot < cpu->config.fetch_width; slot++)
+        {
+            /* Wrong-path fetch ran off the program, wait for the redirect */
+            if (get_code_memory_index_from_pc(cpu->pc) < 0 ||
+                get_code_memory_index_from_pc(cpu->pc) >= cpu->code_memory_size)
+            {
+                APEX_TRACE(cpu, TRACE_FETCH, TRACE_LEVEL_STAGE, "Fetch: pc %d outside code\n", cpu->pc);
                 break;
+            }
 
-            // Lookup branch instruction in BTB to determine if it's a hit or miss -H
-            case OPCODE_BZ:
-                cpu->fetch.vfu = BRANCH_VFU;
+            /* Store current PC in fetch latch */
+            cpu->fetch.pc = cpu->pc;
+
+            /* Index into code memory using this pc and copy all instruction fields
+             * into fetch latch  */
+            current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
+            cpu->fetch.opcode = current_ins->opcode;
+            cpu->fetch.vfu = current_ins->vfu;
+            cpu->fetch.rd = current_ins->rd;
+            cpu->fetch.rs1 = current_ins->rs1;
+            cpu->fetch.rs2 = current_ins->rs2;
+            cpu->fetch.imm = current_ins->imm;
+            cpu->fetch.btb_miss = TRUE;
+            cpu->fetch.pred_target = -1;
+            cpu->fetch.fetch_cycle = cpu->clock;
+
+            if (current_ins->flags & INSN_COND_BRANCH) {
+                // Lookup branch instruction in BTB to determine if it's a hit or miss -H
                 // If BTB entry is valid, it results in a HIT. Otherwise results in a MISS -H
-                if(cpu->btb[0].valid) {
+                const BTB_Entry *entry = APEX_btb_lookup(cpu, cpu->pc);
+                cpu->fetch.pred_taken = APEX_predictor_predict(cpu, cpu->pc, entry);
+                cpu->fetch.pred_history = cpu->branch_history;
+                if(entry) {
                     cpu->fetch.btb_miss = FALSE;
-                    // If HIT, set predicition based on btb lookup -H
-                    cpu->fetch.btb_prediciton = cpu->btb[0].outcome;
-                } else {
-                    cpu->fetch.btb_miss = TRUE;
+                    // If HIT, set predicition based on the direction predictor -H
+                    cpu->fetch.btb_prediciton = cpu->fetch.pred_taken;
+                    target = entry->target;
                 }
-                break;
-
-            case OPCODE_BNZ:
-                cpu->fetch.vfu = BRANCH_VFU;
-                // If BTB entry is valid, it results in a HIT. Otherwise results in a MISS -H
-                if(cpu->btb[1].valid) {
-                    cpu->fetch.btb_miss = FALSE;
-                    // If HIT, set predicition based on btb lookup -H
-                    cpu->fetch.btb_prediciton = cpu->btb[1].outcome;
-                } else {
-                    cpu->fetch.btb_miss = TRUE;
+            } else if (current_ins->opcode == OPCODE_RET) {
+                // Follow the return stack, the branch unit checks the target -J
+                cpu->fetch.pred_target = APEX_ras_pop(cpu);
+            } else if (current_ins->flags & INSN_INDIRECT) {
+                // JUMP/JALR follow the target cache, also checked in the branch unit -J
+                cpu->fetch.pred_history = cpu->path_history;
+                cpu->fetch.pred_target = APEX_itc_lookup(cpu, cpu->pc, cpu->path_history);
+                if (current_ins->opcode == OPCODE_JALR) {
+                    APEX_ras_push(cpu, cpu->pc + 4);
                 }
-                break;
+            }
+            // A wrong path can only pop below this top and push over the entry under it -J
+            cpu->fetch.ras_top = cpu->ras_top;
+            cpu->fetch.ras_entry = cpu->ras[(cpu->ras_top + cpu->config.ras_size - 1) % cpu->config.ras_size];
 
-            case OPCODE_BP:
-                cpu->fetch.vfu = BRANCH_VFU;
-                // If BTB entry is valid, it results in a HIT. Otherwise results in a MISS -H
-                if(cpu->btb[2].valid) {
-                    cpu->fetch.btb_miss = FALSE;
-                    // If HIT, set predicition based on btb lookup -H
-                    cpu->fetch.btb_prediciton = cpu->btb[2].outcome;
-                } else {
-                    cpu->fetch.btb_miss = TRUE;
-                }
-                break;
+            /* Update PC for next instruction */
+            // If BTB Hit and predicition is taken, then change PC value to imm -H
 
-            case OPCODE_BNP:
-                cpu->fetch.vfu = BRANCH_VFU;
-                // If BTB entry is valid, it results in a HIT. Otherwise results in a MISS -H
-                if(cpu->btb[3].valid) {
-                    cpu->fetch.btb_miss = FALSE;
-                    // If HIT, set predicition based on btb lookup -H
-                    cpu->fetch.btb_prediciton = cpu->btb[3].outcome;
-                } else {
-                    cpu->fetch.btb_miss = TRUE;
-                }
-                break;
+            if(cpu->fetch.btb_miss == FALSE && cpu->fetch.btb_prediciton == 1) {
+                cpu->pc = target;
+            } else if (cpu->fetch.pred_target >= 0) {
+                cpu->pc = cpu->fetch.pred_target;
+            } else {
+                cpu->pc += 4;
+            }
+            APEX_TRACE(cpu, TRACE_FETCH, TRACE_LEVEL_STAGE, "Fetch: %d\n", cpu->fetch.opcode);
+            /* Copy data from fetch latch to decode latch*/
+            cpu->decode1[slot] = cpu->fetch;
 
-            case OPCODE_JUMP:
-            case OPCODE_JALR:
-            case OPCODE_RET:
-                // Check if other branches are in the pipeline and stall -H
-                if(cpu->branch_flag == TRUE) {
-                  cpu->fetch.stall = TRUE;
-                } else {
-                  // Set branch flag to avoid multiple branches in the pipeline -H
-                  cpu->branch_flag = TRUE;
-
-                  cpu->fetch.btb_miss = TRUE;
-                  cpu->fetch.vfu = BRANCH_VFU;
-                }
+            /* Stop fetching new instructions if HALT is fetched */
+            if (cpu->fetch.opcode == OPCODE_HALT)
+            {
+                cpu->fetch.has_insn = FALSE;
                 break;
+            }
 
-            case OPCODE_HALT:
-                cpu->fetch.btb_miss = TRUE;
-                cpu->fetch.vfu = BRANCH_VFU;
+            /* A group ends at any branch: it either redirected fetch here or
+             * may be redirected by decode1, which expects it last in its group */
+            if (current_ins->flags & (INSN_COND_BRANCH | INSN_INDIRECT))
+            {
                 break;
+            }
+        }
+    } else APEX_TRACE(cpu, TRACE_FETCH, TRACE_LEVEL_STAGE, "Fetch:\n");
+}
 
+/*
+ * Physical register free list: one bit per register, set when free.
+ * Allocation takes the lowest free register, and any number of registers
+ * can be returned in a cycle.
+ */
+static int alloc_phys_reg(APEX_CPU* cpu){
+    for(int w = 0; w < cpu->free_words; w++){
+        if(cpu->free_list[w]){
+            int reg = w * 64 + __builtin_ctzll(cpu->free_list[w]);
+
+            cpu->free_list[w] &= cpu->free_list[w] - 1;
+            cpu->free_count--;
+            cpu->phys_regs[reg].maps = 0;
+            return reg;
         }
+    }
+    return -1;
+}
+
+static void free_phys_reg(APEX_CPU* cpu, int reg){
+    uint64_t bit = (uint64_t)1 << (reg % 64);
+
+    cpu->free_list[reg / 64] |= bit;
+    cpu->free_count++;
+    //Every live branch checkpoint is younger than the register's last use, so it is free there too -J
+    for(uint64_t live = cpu->branch_ckpt_live; live; live &= live - 1){
+        int id = __builtin_ctzll(live);
+
+        cpu->branch_ckpt_free[id * cpu->free_words + reg / 64] |= bit;
+        cpu->branch_ckpt[id].free_count++;
+    }
+}
+
+/* A flag writer's register may also be the flags mapping, so a register is
+ * only free once a committed instruction has replaced both */
+static void release_phys_reg(APEX_CPU* cpu, int reg){
+    if(--cpu->phys_regs[reg].maps == 0){
+        free_phys_reg(cpu, reg);
+    }
+}
+
+/* Gives arch_reg a new physical register; the ROB entry remembers the old
+ * mapping so it can be released when this instruction commits */
+static int rename_dest(APEX_CPU* cpu, int arch_reg, int rob_id){
+    int reg = alloc_phys_reg(cpu);
+
+    cpu->rob[rob_id].prev_phys_reg = cpu->rename_table.phys[arch_reg];
+    cpu->rename_table.phys[arch_reg] = reg;
+    cpu->phys_regs[reg].maps++;
+    return reg;
+}
 
-        cpu->fetch.rd = current_ins->rd;
-        cpu->fetch.rs1 = current_ins->rs1;
-        cpu->fetch.rs2 = current_ins->rs2;
-        cpu->fetch.imm = current_ins->imm;
+/* The flags are renamed to the flag writer's destination register, which
+ * gets them in its cc bits (CMP allocates one just for that) */
+static void rename_flags(APEX_CPU* cpu, int reg, int rob_id){
+    cpu->rob[rob_id].flags_reg = reg;
+    cpu->rob[rob_id].prev_flags_reg = cpu->rename_table.phys[CC_INDEX];
+    cpu->rename_table.phys[CC_INDEX] = reg;
+    cpu->phys_regs[reg].maps++;
+}
+
+/* Source lookups; an architectural register that was never renamed (tag
+ * -1) reads as a ready value from the architectural file */
+static int phys_ready(const APEX_CPU* cpu, int tag){
+    return tag < 0 || cpu->phys_regs[tag].src_bit;
+}
+
+static int phys_value(const APEX_CPU* cpu, int tag, int arch){
+    return tag < 0 ? cpu->arch_regs[arch].value : cpu->phys_regs[tag].value;
+}
+
+static int phys_flags(const APEX_CPU* cpu, int tag){
+    if(tag < 0){
+        return (cpu->zero_flag ? CC_ZERO : 0) | (cpu->positive_flag ? CC_POSITIVE : 0);
+    }
+    return cpu->phys_regs[tag].cc;
+}
+
+/*
+ * Branch checkpoints: decode2 takes one after every branch that may
+ * mispredict (conditional branches, and JUMP/JALR/RET fetched down a
+ * predicted target) and the branch unit frees it on resolution, restoring
+ * it first on a mispredict. Seqs compare by difference, so they may wrap.
+ */
+static int seq_younger(unsigned int seq, unsigned int than){
+    return (int)(seq - than) > 0;
+}
+
+static int branch_ckpt_available(const APEX_CPU* cpu){
+    return __builtin_popcountll(cpu->branch_ckpt_live) < cpu->config.branch_checkpoints;
+}
+
+static void take_branch_ckpt(APEX_CPU* cpu, const CPU_Stage* branch){
+    int id = __builtin_ctzll(~cpu->branch_ckpt_live);
+    Branch_Checkpoint *ckpt = &cpu->branch_ckpt[id];
+
+    ckpt->seq = branch->seq;
+    ckpt->rob_tail = cpu->rob_tail;
+    ckpt->map = cpu->rename_table;
+    ckpt->free_count = cpu->free_count;
+    ckpt->ras_top = branch->ras_top;
+    ckpt->ras_entry = branch->ras_entry;
+    memcpy(&cpu->branch_ckpt_free[id * cpu->free_words], cpu->free_list,
+           cpu->free_words * sizeof(uint64_t));
+    cpu->branch_ckpt_live |= (uint64_t)1 << id;
+}
 
-        /* Update PC for next instruction */
-        // If BTB Hit and predicition is taken, then change PC value to imm -H
+/* Checkpoint the branch dispatched as seq took, -1 if it has none */
+static int find_branch_ckpt(const APEX_CPU* cpu, unsigned int seq){
+    for(uint64_t live = cpu->branch_ckpt_live; live; live &= live - 1){
+        int id = __builtin_ctzll(live);
 
-        if(cpu->fetch.btb_miss == FALSE && cpu->fetch.btb_prediciton == 1) {
-            cpu->pc = cpu->fetch.pc + cpu->fetch.imm;
-        } else {
-            cpu->pc += 4;
+        if(cpu->branch_ckpt[id].seq == seq){
+            return id;
         }
-        printf("Fetch: %d\n", cpu->fetch.opcode);
-        /* Copy data from fetch latch to decode latch*/
-        cpu->decode1 = cpu->fetch;
+    }
+    return -1;
+}
 
-        /* Stop fetching new instructions if HALT is fetched */
-        if (cpu->fetch.opcode == OPCODE_HALT)
-        {
-            cpu->fetch.has_insn = FALSE;
+/* Appends to the ROB tail and returns the entry's ROB ID (its slot) */
+static int rob_push(APEX_CPU* cpu, const ROB_Entry* entry){
+    int id = cpu->rob_tail;
+
+    cpu->rob[id] = *entry;
+    cpu->rob_tail = (cpu->rob_tail + 1) % cpu->config.rob_size;
+    cpu->rob_count++;
+    return id;
+}
+
+/* Appends a dispatched LOAD/STORE to the LSQ tail and returns its lsq_id */
+static int lsq_push(APEX_CPU* cpu, const CPU_Stage* stage){
+    int id = cpu->lsq_tail;
+    LSQ_Entry *entry = &cpu->lsq[id];
+
+    entry->pc = stage->pc;
+    entry->opcode = stage->opcode;
+    entry->seq = stage->seq;
+    entry->rob_id = stage->rob_id;
+    entry->dest = stage->rd;
+    entry->data_tag = -1;
+    entry->addr_known = FALSE;
+    entry->data_known = FALSE;
+    entry->issued = FALSE;
+    cpu->lsq_tail = (cpu->lsq_tail + 1) % cpu->config.lsq_size;
+    cpu->lsq_count++;
+    return id;
+}
+
+/* The LSQ entry of the memory instruction dispatched as seq */
+static LSQ_Entry* lsq_find(APEX_CPU* cpu, unsigned int seq){
+    for(int n = 0, id = cpu->lsq_head; n < cpu->lsq_count; n++, id = (id + 1) % cpu->config.lsq_size){
+        if(cpu->lsq[id].seq == seq){
+            return &cpu->lsq[id];
         }
-    } else printf("Fetch:\n");
+    }
+    return NULL;
+}
+
+/* Whether LSQ slot id holds an entry */
+static int lsq_live(const APEX_CPU* cpu, int id){
+    return (id - cpu->lsq_head + cpu->config.lsq_size) % cpu->config.lsq_size < cpu->lsq_count;
 }
 
-static char available_ROB(APEX_CPU* cpu){
-    if(cpu->rob->size() == 16){
+/* A STORE is done in the pipeline once it has both its address and data; memory is the store buffer's job */
+static void lsq_store_known(APEX_CPU* cpu, const LSQ_Entry* entry){
+    if(entry->addr_known && entry->data_known){
+        cpu->rob[entry->rob_id].status_bit = 1;
+    }
+}
+
+/* Room for `needed` more entries (older slots of a decode group count too) */
+static char available_ROB(APEX_CPU* cpu, int needed){
+    if(cpu->rob_count + needed > cpu->config.rob_size){
         return FALSE;
     }else{
         return TRUE;
     }
 }
 
-static char available_IQ(APEX_CPU* cpu){
-    for(int i = 0; i < 8; i++){
-        if(cpu->iq[i].status_bit == 0){
+static char available_IQ(APEX_CPU* cpu, int needed){
+    return __builtin_popcountll(~cpu->iq_valid & cpu->iq_slots) >= needed ? TRUE : FALSE;
+}
+
+static int index_IQ(APEX_CPU* cpu){//Finds the first valid index to write into -J
+    uint64_t free_slots = ~cpu->iq_valid & cpu->iq_slots;
+
+    return free_slots ? __builtin_ctzll(free_slots) : IQ_NONE;
+}
+
+/*
+ * Whether the operands an IQ entry waits on have all been captured. Only
+ * evaluated when the entry is dispatched or woken up; select itself just
+ * reads cpu->iq_ready.
+ */
+static int
+iq_operands_ready(const IQ_Entry* entry){
+    switch(entry->opcode){
+        //src1 & src2
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_EXOR:
+        case OPCODE_CMP:
+            return entry->src1_rdy_bit && entry->src2_rdy_bit;
+
+        //STORE only needs its address base, the data can follow it into the LSQ
+        case OPCODE_STORE:
+            return entry->src2_rdy_bit;
+
+        //only src1 -H
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_LOAD:
+        case OPCODE_JUMP:
+        case OPCODE_RET:
+        case OPCODE_JALR:
+            return entry->src1_rdy_bit;
+
+        //literal, and the flags as src1
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+            return entry->src1_rdy_bit;
+
+        //only literals
+        case OPCODE_MOVC:
+        case OPCODE_NOP:
+        case OPCODE_HALT:
             return TRUE;
-        }
     }
     return FALSE;
 }
 
-static char index_IQ(APEX_CPU* cpu){//Finds the first valid index to write into -J
-    for(char i = 0; i < 8; i++){
-        if(cpu->iq[i].status_bit == 0){
+/* Places a dispatched instruction in IQ slot entry_index as the youngest entry */
+static void
+iq_insert(APEX_CPU* cpu, int entry_index){
+    uint64_t bit = IQ_BIT(entry_index);
+
+    //Every valid entry is older than this one; drop the slot's previous occupant from their age rows
+    for(uint64_t rows = cpu->iq_valid; rows; rows &= rows - 1){
+        cpu->iq_older[__builtin_ctzll(rows)] &= ~bit;
+    }
+    cpu->iq_older[entry_index] = cpu->iq_valid;
+
+    cpu->iq_valid |= bit;
+    cpu->iq_fu_mask[cpu->iq[entry_index].fu_type] |= bit;
+    if(iq_operands_ready(&cpu->iq[entry_index])){
+        cpu->iq_ready |= bit;
+    }
+}
+
+static void
+iq_remove(APEX_CPU* cpu, int entry_index){
+    uint64_t bit = IQ_BIT(entry_index);
+
+    cpu->iq[entry_index].status_bit = 0;
+    cpu->iq_valid &= ~bit;
+    cpu->iq_ready &= ~bit;
+    cpu->iq_fu_mask[cpu->iq[entry_index].fu_type] &= ~bit;
+}
+
+/* Oldest entry in a non-empty candidate mask: the one with no older candidate */
+static int
+iq_oldest(const APEX_CPU* cpu, uint64_t candidates){
+    for(uint64_t c = candidates; c; c &= c - 1){
+        int i = __builtin_ctzll(c);
+
+        if((cpu->iq_older[i] & candidates) == 0){
             return i;
         }
     }
-    return -1;
+    return IQ_NONE;
 }
 /*
  * Decode Stage of APEX Pipeline
@@ -523,120 +752,163 @@ Rj <-- Rk <op> Rl
 
 Stall if free list isn't empty
 
+The group advances in order: every slot needs its own ROB/IQ entry (and
+LSQ entry / phys reg), so the checks count what the older slots of this
+group already claimed. A stalled slot holds itself and everything younger.
+
 - J
 */
-    if(cpu->decode1.has_insn == TRUE){
+    int advanced = 0;
+    int lsq_used = 0, regs_used = 0; //Claimed by older slots of this group -J
+    unsigned int group_writes = 0; //Arch registers older slots of this group write, not renamed yet -J
 
-        if(!available_ROB(cpu) || !available_IQ(cpu)){//All instructions need a slot in the ROB & IQ -J
-            cpu->fetch.stall = TRUE; //Stall -J
-            return;
-        } else{
+    int held = cpu->decode2[0].has_insn; //decode2 is still holding (part of) its group -J
 
-            cpu->fetch.stall = FALSE; //Set it back if it was set in previous check -J
+    for(int slot = 0; slot < cpu->config.fetch_width && cpu->decode1[slot].has_insn == TRUE && !held; slot++){
+        CPU_Stage *d1 = &cpu->decode1[slot];
+        const APEX_Instruction *ins = &cpu->code_memory[get_code_memory_index_from_pc(d1->pc)];
+        int stall = FALSE;
 
-            switch (cpu->decode1.opcode){//This switch is for checking LSQ & Free List -J
-                // Operations with a destination register need to be able to allocate a new physical register
-                case OPCODE_ADD:
-                case OPCODE_ADDL:
-                case OPCODE_SUB:
-                case OPCODE_SUBL:
-                case OPCODE_MUL:
-                case OPCODE_MOVC:
-                case OPCODE_AND:
-                case OPCODE_OR:
-                case OPCODE_EXOR:
-                case OPCODE_CMP:
-                    //Free List check -J
-                   if(cpu->free_list->empty()){
-                        cpu->fetch.stall = TRUE;
+        if(!available_ROB(cpu, slot + 1) || !available_IQ(cpu, slot + 1)){//All instructions need a slot in the ROB & IQ -J
+            break; //Stall -J
+        }
 
-                    }
-                    break;
+        switch (d1->opcode){//This switch is for checking LSQ & Free List -J
+            // Operations with a destination register need to be able to allocate a new physical register
+            case OPCODE_ADD:
+            case OPCODE_ADDL:
+            case OPCODE_SUB:
+            case OPCODE_SUBL:
+            case OPCODE_MUL:
+            case OPCODE_MOVC:
+            case OPCODE_AND:
+            case OPCODE_OR:
+            case OPCODE_EXOR:
+            case OPCODE_CMP:
+                //Free List check -J
+               if(cpu->free_count - regs_used == 0){
+                    stall = TRUE;
+                }
+                break;
 
-                // Memory operations w/ destination regsiter
-                case OPCODE_LOAD:
+            // Memory operations w/ destination regsiter
+            case OPCODE_LOAD:
 
-                    //LSQ / Free List check  -J
-                    if(cpu->lsq->size() == 6 || cpu->free_list->empty()){ //LOAD needs both INT_VFU and MEM Unit -J
-                        cpu->fetch.stall = TRUE;
-                    }
-                    break;
+                //LSQ / Free List check  -J
+                if(cpu->lsq_count + lsq_used == cpu->config.lsq_size || cpu->free_count - regs_used == 0){ //LOAD needs both INT_VFU and MEM Unit -J
+                    stall = TRUE;
+                }
+                break;
 
-                // Memory operation w/out destination register
-                case OPCODE_STORE:
+            // Memory operation w/out destination register
+            case OPCODE_STORE:
 
-                    //LSQ check -J
-                    if(cpu->lsq->size() == 6){
-                        cpu->fetch.stall = TRUE;
-                    }
-                    break;
+                //LSQ check -J
+                if(cpu->lsq_count + lsq_used == cpu->config.lsq_size){
+                    stall = TRUE;
+                }
+                break;
+
+            case OPCODE_BZ:
+            case OPCODE_BNZ:
+            case OPCODE_BP:
+            case OPCODE_BNP:
+                //Free List check -J
+               if(cpu->free_count - regs_used == 0){
+                    stall = TRUE;
+                }
+                // If btb miss, the target is pc + imm, so follow the direction predictor -H
+                if(d1->btb_miss == TRUE){
+                    d1->btb_prediciton = d1->pred_taken;
+                }
+                //Needs a checkpoint to recover from a mispredict -J
+                if(!branch_ckpt_available(cpu)){
+                    stall = TRUE;
+                }
+                break;
+
+            case OPCODE_JUMP:
+            case OPCODE_JALR:
+            case OPCODE_RET:
+                //Free List check -J
+               if(cpu->free_count - regs_used == 0){
+                    stall = TRUE;
+                }
+                // Default is always taken -H
+                d1->btb_prediciton = 1;
+                // Target is read below and never checked in execute, wait for the register,
+                // unless fetch already followed the return stack -J
+                if(d1->pred_target < 0 && ((group_writes >> d1->rs1) & 1 ||
+                                           !phys_ready(cpu, cpu->rename_table.phys[d1->rs1]))){
+                    stall = TRUE;
+                }
+                if(d1->pred_target >= 0 && !branch_ckpt_available(cpu)){
+                    stall = TRUE;
+                }
+                break;
+        }
 
+        // If we are waiting on a resource stall
+        if (stall) {
+            break;
+        }
+
+        if (ins->flags & (INSN_HAS_RD | INSN_SETS_FLAGS)) {
+            regs_used++; //CMP takes one for its flags
+        }
+        if (ins->flags & INSN_HAS_RD) {
+            group_writes |= 1u << d1->rd;
+        }
+        if (ins->flags & INSN_MEM) {
+            lsq_used++;
+        }
+
+        // If BTB predicition is taken, change PC value -H
+        // Fetch ends a group at any branch, so nothing younger is in this group
+        if (d1->btb_prediciton == 1 && d1->pred_target < 0) {
+            int pred_phys_reg_id = 0;
+            switch (d1->opcode) {
                 case OPCODE_BZ:
                 case OPCODE_BNZ:
                 case OPCODE_BP:
                 case OPCODE_BNP:
-                    //Free List check -J
-                   if(cpu->free_list->empty()){
-                        cpu->fetch.stall = TRUE;
-
-                    }
-                    // If btb miss, set default predicition of Taken -H
-                    if(cpu->decode1.btb_miss == TRUE){
-                        cpu->decode1.btb_prediciton = 1;
-                    }
-                    break;
+                    cpu->pc = d1->pc + d1->imm;
+                    break;
 
                 case OPCODE_JUMP:
                 case OPCODE_JALR:
-                case OPCODE_RET:
-                    //Free List check -J
-                   if(cpu->free_list->empty()){
-                        cpu->fetch.stall = TRUE;
+                    pred_phys_reg_id = cpu->rename_table.phys[d1->rs1];
+                    cpu->pc = phys_value(cpu, pred_phys_reg_id, d1->rs1) + d1->imm;
+                    break;
 
-                    }
-                    // Default is always taken -H
-                    cpu->decode1.btb_prediciton = 1;
+                case OPCODE_RET:
+                    pred_phys_reg_id = cpu->rename_table.phys[d1->rs1];
+                    cpu->pc = phys_value(cpu, pred_phys_reg_id, d1->rs1);
                     break;
             }
 
+            //Prevent new instruction from being fetched in current cycle -H
+            cpu->fetch_from_next_cycle = TRUE;
+            cpu->fetch.has_insn = TRUE;
+        }
+        APEX_TRACE(cpu, TRACE_DECODE, TRACE_LEVEL_STAGE, "Decode1: %d\n", d1->opcode);
+        cpu->decode2[slot] = *d1; //decode2 dispatched its whole group earlier this cycle -J
+        d1->has_insn = FALSE;
+        advanced++;
+    }
 
-            // If we are waiting on a resource stall
-            if (cpu->fetch.stall != TRUE) {
-                // If BTB predicition is taken, change PC value -H
-                if (cpu->decode1.btb_prediciton == 1) {
-                    int pred_phys_reg_id = 0;
-                    switch (cpu->decode1.opcode) {
-                        case OPCODE_BZ:
-                        case OPCODE_BNZ:
-                        case OPCODE_BP:
-                        case OPCODE_BNP:
-                            cpu->pc = cpu->decode1.pc + cpu->decode1.imm;
-                            break;
-
-                        case OPCODE_JUMP:
-                        case OPCODE_JALR:
-                            pred_phys_reg_id = cpu->rename_table[cpu->decode1.rs1].phys_reg_id;
-                            cpu->pc = cpu->phys_regs[pred_phys_reg_id].value + cpu->decode1.imm;
-                            break;
-
-                        case OPCODE_RET:
-                            pred_phys_reg_id = cpu->rename_table[cpu->decode1.rs1].phys_reg_id;
-                            cpu->pc = cpu->phys_regs[pred_phys_reg_id].value;
-                            break;
-                    }
+    if(advanced == 0 && cpu->decode1[0].has_insn == FALSE){
+        APEX_TRACE(cpu, TRACE_DECODE, TRACE_LEVEL_STAGE, "Decode1:\n");
+    }
 
-                    //Prevent new instruction from being fetched in current cycle -H
-                    cpu->fetch_from_next_cycle = TRUE;
-                    cpu->fetch.has_insn = TRUE;
-                }
-                printf("Decode1: %d\n", cpu->decode1.opcode);
-                cpu->decode2 = cpu->decode1;
-                cpu->decode1.has_insn = FALSE;
-                cpu->fetch.stall = FALSE;
-            }
+    //Stalled slots move to the front; fetch waits until the group has drained -J
+    if(advanced > 0){
+        for(int slot = advanced; slot < cpu->config.fetch_width; slot++){
+            cpu->decode1[slot - advanced] = cpu->decode1[slot];
+            cpu->decode1[slot].has_insn = FALSE;
         }
-    } else printf("Decode1:\n");
-
+    }
+    cpu->fetch.stall = cpu->decode1[0].has_insn ? TRUE : FALSE;
 }
 
 static void
@@ -650,371 +922,339 @@ Rj <-- Rk <op> Rl
 
 6) Dispatch to IQ (& LSQ if need be)
 
+Slots are renamed oldest first, so a slot sees the mappings made by the
+older slots of its group (intra-group dependencies) -J
+
 */
-    if(cpu->decode2.has_insn == TRUE){
-       int free_reg = -1; //If it stays -1, then we know that it's an instruction w/o a destination
-
-       // Insert entry into ROB before renaming -H
-       ROB_Entry rob_entry;
-       rob_entry.pc_value = cpu->decode2.pc;
-       rob_entry.ar_addr = cpu->decode2.rd;
-       rob_entry.status_bit = 0;
-       rob_entry.opcode = cpu->decode2.opcode;
-       cpu->rob->push_back(rob_entry);
-
-       switch(cpu->decode2.opcode){//Handling the instruction renaming -J
-                //<dest> <- <src1> <op> <src2> -J
+    int dispatched = 0;
+
+    for(int slot = 0; slot < cpu->config.fetch_width && cpu->decode2[slot].has_insn == TRUE; slot++){
+        CPU_Stage *d2 = &cpu->decode2[slot];
+        uint8_t flags = cpu->code_memory[get_code_memory_index_from_pc(d2->pc)].flags;
+
+        dispatched++;
+           int free_reg = -1; //If it stays -1, then we know that it's an instruction w/o a destination
+           int arch_rs1 = d2->rs1, arch_rs2 = d2->rs2; //Renaming overwrites the sources below
+
+           // Insert entry into ROB before renaming -H
+           ROB_Entry rob_entry;
+           rob_entry.pc_value = d2->pc;
+           rob_entry.ar_addr = d2->rd;
+           rob_entry.status_bit = 0;
+           rob_entry.opcode = d2->opcode;
+           rob_entry.prev_phys_reg = -1;
+           rob_entry.flags_reg = -1;
+           rob_entry.prev_flags_reg = -1;
+           d2->rob_id = rob_push(cpu, &rob_entry);
+           d2->seq = ++cpu->dispatch_seq;
+
+           switch(d2->opcode){//Handling the instruction renaming -J
+                    //<dest> <- <src1> <op> <src2> -J
+                    case OPCODE_ADD:
+                    case OPCODE_SUB:
+                    case OPCODE_MUL:
+                    case OPCODE_AND:
+                    case OPCODE_OR:
+                    case OPCODE_EXOR:
+                        //Both sources must be valid before we can grab the data (Stall if not) -J
+                        d2->rs1 = cpu->rename_table.phys[d2->rs1]; //Take arch reg and turn it to phys through lookup -J
+                        d2->rs2 = cpu->rename_table.phys[d2->rs2];
+                        free_reg = rename_dest(cpu, d2->rd, d2->rob_id);
+                        d2->rd = free_reg;
+                        cpu->phys_regs[d2->rd].src_bit = 0; //Have to set dest src_bit to zero since we'll now be in the process of setting that value -J
+                        break;
+
+                    //<dest> <- <src1> <op> <literal> -H
+                    case OPCODE_ADDL:
+                    case OPCODE_SUBL:
+                    case OPCODE_LOAD:
+                    case OPCODE_JALR:
+                        d2->rs1 = cpu->rename_table.phys[d2->rs1];
+                        free_reg = rename_dest(cpu, d2->rd, d2->rob_id);
+                        d2->rd = free_reg;
+                        cpu->phys_regs[d2->rd].src_bit = 0;
+                        break;
+
+                    //<dest> <- #<literal> -J
+                    case OPCODE_MOVC:
+                        free_reg = rename_dest(cpu, d2->rd, d2->rob_id);
+                        // Set the destination register to the physical register just retrieved from the free list -H
+                        d2->rd = free_reg;
+                        cpu->phys_regs[d2->rd].src_bit = 0;
+                        break;
+
+                    // Opcodes which have 2 source registers and no destination register - H
+                    //<src1> <src2> #<literal> -J
+                    //<op> <src1> <src2> -J
+                    case OPCODE_STORE:
+                    case OPCODE_CMP:
+                        d2->rs1 = cpu->rename_table.phys[d2->rs1];
+                        d2->rs2 = cpu->rename_table.phys[d2->rs2];
+                        break;
+
+                    // Opcodes which have a single source register and no destination register - H
+                    //<branch> <src1> #<literal> -J
+                    case OPCODE_JUMP:
+                    case OPCODE_RET:
+                        d2->rs1 = cpu->rename_table.phys[d2->rs1];
+                        break;
+
+                    // BZ, BNZ, BP, and BNP have no source registers, their source is the flags mapping -H
+                    case OPCODE_BZ:
+                    case OPCODE_BNZ:
+                    case OPCODE_BP:
+                    case OPCODE_BNP:
+                        d2->rs1 = cpu->rename_table.phys[CC_INDEX];
+                        break;
+                }
+                if(flags & INSN_SETS_FLAGS){
+                    if(d2->opcode == OPCODE_CMP){
+                        //No destination, the flags get a register of their own -J
+                        d2->rd = alloc_phys_reg(cpu);
+                        cpu->phys_regs[d2->rd].src_bit = 0;
+                    }
+                    rename_flags(cpu, d2->rd, d2->rob_id);
+                }
+
+            //Filling out IQ entry -J
+            int entry_index = index_IQ(cpu);
+            cpu->iq[entry_index].status_bit = 1;
+            //cpu->iq[entry_index].iq_time_padding = 0;
+            cpu->iq[entry_index].fu_type = d2->vfu;
+            cpu->iq[entry_index].opcode = d2->opcode;
+            switch(d2->opcode){//Instructions w/ literals -J
+                case OPCODE_ADDL:
+                case OPCODE_SUBL:
+                case OPCODE_LOAD:
+                case OPCODE_STORE:
+                case OPCODE_JUMP:
+                case OPCODE_MOVC:
+                case OPCODE_BP:
+                case OPCODE_BNP:
+                case OPCODE_JALR:
+                case OPCODE_BZ:
+                case OPCODE_BNZ:
+                    cpu->iq[entry_index].literal = d2->imm;
+            }
+
+            switch(d2->opcode){//Instructions w/ src1 -J
                 case OPCODE_ADD:
+                case OPCODE_ADDL:
                 case OPCODE_SUB:
+                case OPCODE_SUBL:
                 case OPCODE_MUL:
                 case OPCODE_AND:
                 case OPCODE_OR:
                 case OPCODE_EXOR:
-                    //Both sources must be valid before we can grab the data (Stall if not) -J
-                    cpu->decode2.rs1 = cpu->rename_table[cpu->decode2.rs1].phys_reg_id; //Take arch reg and turn it to phys through lookup -J
-                    cpu->decode2.rs2 = cpu->rename_table[cpu->decode2.rs2].phys_reg_id;
-                    free_reg = cpu->free_list->front();
-                    cpu->free_list->pop();
-                    cpu->rename_table[cpu->decode2.rd].phys_reg_id = free_reg;
-                    cpu->decode2.rd = free_reg;
-                    cpu->phys_regs[cpu->decode2.rd].src_bit = 0; //Have to set dest src_bit to zero since we'll now be in the process of setting that value -J
-                    break;
-
-                //<dest> <- <src1> <op> <literal> -H
-                case OPCODE_ADDL:
-                case OPCODE_SUBL:
                 case OPCODE_LOAD:
+                case OPCODE_STORE:
+                case OPCODE_JUMP:
                 case OPCODE_JALR:
-                    cpu->decode2.rs1 = cpu->rename_table[cpu->decode2.rs1].phys_reg_id;
-                    free_reg = cpu->free_list->front();
-                    cpu->free_list->pop();
-                    cpu->rename_table[cpu->decode2.rd].phys_reg_id = free_reg;
-                    cpu->decode2.rd = free_reg;
-                    cpu->phys_regs[cpu->decode2.rd].src_bit = 0;
-                    break;
-
-                //<dest> <- #<literal> -J
-                case OPCODE_MOVC:
-                    free_reg = cpu->free_list->front();
-                    cpu->free_list->pop();
-                    cpu->rename_table[cpu->decode2.rd].phys_reg_id = free_reg;
-                    // Set the destination register to the physical register just retrieved from the free list -H
-                    cpu->decode2.rd = free_reg;
-                    cpu->phys_regs[cpu->decode2.rd].src_bit = 0;
+                case OPCODE_RET:
+                case OPCODE_CMP:
+                    cpu->iq[entry_index].src1_rdy_bit = phys_ready(cpu, d2->rs1);
+                    cpu->iq[entry_index].src1_tag = d2->rs1;
+                    if(cpu->iq[entry_index].src1_rdy_bit){
+                        cpu->iq[entry_index].src1_val = phys_value(cpu, d2->rs1, arch_rs1);
+                    }else{
+                        cpu->wakeup[d2->rs1].push_back(entry_index);
+                    }
                     break;
 
-                // Opcodes which have 2 source registers and no destination register - H
-                //<src1> <src2> #<literal> -J
-                //<op> <src1> <src2> -J
+            }
+            switch (d2->opcode){//Instructions w/ src2 -J
+                case OPCODE_ADD:
+                case OPCODE_ADDL:
+                case OPCODE_SUB:
+                case OPCODE_MUL:
+                case OPCODE_AND:
+                case OPCODE_OR:
+                case OPCODE_EXOR:
                 case OPCODE_STORE:
                 case OPCODE_CMP:
-                    cpu->decode2.rs1 = cpu->rename_table[cpu->decode2.rs1].phys_reg_id;
-                    cpu->decode2.rs2 = cpu->rename_table[cpu->decode2.rs2].phys_reg_id;
+                    cpu->iq[entry_index].src2_rdy_bit = phys_ready(cpu, d2->rs2);
+                    cpu->iq[entry_index].src2_tag = d2->rs2;
+                    if(cpu->iq[entry_index].src2_rdy_bit){
+                        cpu->iq[entry_index].src2_val = phys_value(cpu, d2->rs2, arch_rs2);
+                    }else if(d2->rs2 != d2->rs1 || cpu->iq[entry_index].src1_rdy_bit){
+                        cpu->wakeup[d2->rs2].push_back(entry_index);
+                    }
+                    break;
+            }
+            switch (d2->opcode){ //Instructions w/ dest -J
+                case OPCODE_ADD:
+                case OPCODE_ADDL:
+                case OPCODE_SUB:
+                case OPCODE_SUBL:
+                case OPCODE_MUL:
+                case OPCODE_AND:
+                case OPCODE_OR:
+                case OPCODE_EXOR:
+                case OPCODE_MOVC:
+                case OPCODE_JALR:
+                case OPCODE_LOAD:
+                case OPCODE_CMP:
+                    cpu->iq[entry_index].dest = d2->rd;
                     break;
 
-                // Opcodes which have a single source register and no destination register - H
-                //<branch> <src1> #<literal> -J
+
+            }
+            switch(d2->opcode){//Branch Instructions -H
                 case OPCODE_JUMP:
+                case OPCODE_BP:
+                case OPCODE_BNP:
+                case OPCODE_JALR:
+                case OPCODE_BZ:
+                case OPCODE_BNZ:
                 case OPCODE_RET:
-                    cpu->decode2.rs1 = cpu->rename_table[cpu->decode2.rs1].phys_reg_id;
-                    break;
-
-                // BZ, BNZ, BP, and BNP don't have any source registers therefore require no action in the rename stage -H
+                    cpu->iq[entry_index].btb_prediciton = d2->btb_prediciton;
+                    cpu->iq[entry_index].pred_history = d2->pred_history;
+                    cpu->iq[entry_index].fetch_cycle = d2->fetch_cycle;
+                    cpu->iq[entry_index].pred_target = d2->pred_target;
             }
 
-        //Filling out IQ entry -J
-        char entry_index = index_IQ(cpu);
-        cpu->iq[entry_index].status_bit = 1;
-        //cpu->iq[entry_index].iq_time_padding = 0;
-        cpu->iq[entry_index].fu_type = cpu->decode2.vfu;
-        cpu->iq[entry_index].opcode = cpu->decode2.opcode;
-        switch(cpu->decode2.opcode){//Instructions w/ literals -J
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_LOAD:
-            case OPCODE_STORE:
-            case OPCODE_JUMP:
-            case OPCODE_MOVC:
-            case OPCODE_BP:
-            case OPCODE_BNP:
-            case OPCODE_JALR:
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-                cpu->iq[entry_index].literal = cpu->decode2.imm;
-        }
-
-        switch(cpu->decode2.opcode){//Instructions w/ src1 -J
-            case OPCODE_ADD:
-            case OPCODE_ADDL:
-            case OPCODE_SUB:
-            case OPCODE_SUBL:
-            case OPCODE_MUL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_EXOR:
-            case OPCODE_LOAD:
-            case OPCODE_STORE:
-            case OPCODE_JUMP:
-            case OPCODE_JALR:
-            case OPCODE_RET:
-            case OPCODE_CMP:
-                cpu->iq[entry_index].src1_rdy_bit = cpu->phys_regs[cpu->decode2.rs1].src_bit;
-                cpu->iq[entry_index].src1_tag = cpu->decode2.rs1;
-                if(cpu->iq[entry_index].src1_rdy_bit){
-                    cpu->iq[entry_index].src1_val = cpu->phys_regs[cpu->decode2.rs1].value;
-                }
-                break;
-
-        }
-        switch (cpu->decode2.opcode){//Instructions w/ src2 -J
-            case OPCODE_ADD:
-            case OPCODE_ADDL:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_EXOR:
-            case OPCODE_STORE:
-            case OPCODE_CMP:
-                cpu->iq[entry_index].src2_rdy_bit = cpu->phys_regs[cpu->decode2.rs2].src_bit;
-                cpu->iq[entry_index].src2_tag = cpu->decode2.rs2;
-                if(cpu->iq[entry_index].src2_rdy_bit){
-                    cpu->iq[entry_index].src2_val = cpu->phys_regs[cpu->decode2.rs2].value;
+            cpu->iq[entry_index].pc_value = d2->pc;
+            cpu->iq[entry_index].rob_id = d2->rob_id;
+            cpu->iq[entry_index].seq = d2->seq;
+            if(flags & INSN_COND_BRANCH){
+                //Wakes up on the youngest older flag writer and reads the flags at issue -J
+                cpu->iq[entry_index].src1_rdy_bit = phys_ready(cpu, d2->rs1);
+                cpu->iq[entry_index].src1_tag = d2->rs1;
+                if(!cpu->iq[entry_index].src1_rdy_bit){
+                    cpu->wakeup[d2->rs1].push_back(entry_index);
                 }
-                break;
-        }
-        switch (cpu->decode2.opcode){ //Instructions w/ dest -J
-            case OPCODE_ADD:
-            case OPCODE_ADDL:
-            case OPCODE_SUB:
-            case OPCODE_SUBL:
-            case OPCODE_MUL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_EXOR:
-            case OPCODE_MOVC:
-            case OPCODE_JALR:
-            case OPCODE_LOAD:
-                cpu->iq[entry_index].dest = cpu->decode2.rd;
-                break;
-
-
-        }
-        switch(cpu->decode2.opcode){//Branch Instructions -H
-            case OPCODE_JUMP:
-            case OPCODE_BP:
-            case OPCODE_BNP:
-            case OPCODE_JALR:
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            case OPCODE_RET:
-                cpu->iq[entry_index].btb_prediciton = cpu->decode2.btb_prediciton;
-        }
+            }
+            iq_insert(cpu, entry_index);
+            if(flags & INSN_COND_BRANCH || d2->pred_target >= 0){
+                take_branch_ckpt(cpu, d2); //Last in its group, so this is the state right after it -J
+            }
 
-        cpu->iq[entry_index].pc_value = cpu->decode2.pc;
+            switch (d2->opcode){//Adding to LSQ if it's a MEM instr -J
+                case OPCODE_LOAD:
+                case OPCODE_STORE:
+                    cpu->iq[entry_index].lsq_id = lsq_push(cpu, d2);
+                    break;
+            }
+               APEX_TRACE(cpu, TRACE_DECODE, TRACE_LEVEL_STAGE, "Decode2: %d\n", d2->opcode);
+            d2->has_insn = FALSE;
+            //We don't forward data in pipeline to exec right away like before bc IQ is Out-of-Order -J
+    }
+    if(!dispatched && cpu->decode2[0].has_insn == FALSE){
+        APEX_TRACE(cpu, TRACE_DECODE, TRACE_LEVEL_STAGE, "Decode2:\n");
+    }
 
-        switch (cpu->decode2.opcode){//Adding to LSQ if it's a MEM instr -J
-            case OPCODE_LOAD:
-            case OPCODE_STORE:
-                if(cpu->lsq->empty()){
-                    cpu->iq[entry_index].lsq_id = 0;
-                }else{
-                    cpu->iq[entry_index].lsq_id = cpu->lsq->front().lsq_id + 1; //Give unique id to new entry -J
-                }
-                cpu->lsq->push(cpu->iq[entry_index]);
-                break;
+    //A waiting branch moves to the front, decode1 holds until it has gone -J
+    if(dispatched > 0){
+        for(int slot = dispatched; slot < cpu->config.fetch_width; slot++){
+            cpu->decode2[slot - dispatched] = cpu->decode2[slot];
+            cpu->decode2[slot].has_insn = FALSE;
         }
-           printf("Decode2: %d\n", cpu->decode2.opcode);
-        cpu->decode2.has_insn = FALSE;
-        //We don't forward data in pipeline to exec right away like before bc IQ is Out-of-Order -J
-    } else printf("Decode2:\n");
-
-}
-
-static int check_LSQ(APEX_CPU* cpu, int entry_index){
-    //Returns 100 if LSQ index cannot be used yet
-    switch (cpu->iq[entry_index].opcode){
-        /*
-        Rules for LOAD
-        1) Entry for LOAD is at the head of LSQ
-        2) All fields are valid (checked prior to tiebreaker_IQ())
-        3) Memory is free
-        */
-        case OPCODE_LOAD:
-            if(cpu->memory.has_insn == FALSE &&
-                cpu->iq[entry_index].pc_value == cpu->lsq->front().pc_value){
-                return entry_index;
-            }
-            break;
-        /*
-        Rules for STORE
-        1) All inputs are valid (checked prior to tiebreaker_IQ())
-        2) When STORE entry is at the head of the ROB and LSQ
-        3) When memory is free
-        */
-        case OPCODE_STORE:
-            if(cpu->memory.has_insn == FALSE &&
-                cpu->iq[entry_index].pc_value == cpu->lsq->front().pc_value &&
-                cpu->iq[entry_index].pc_value == cpu->rob->front().pc_value){
-                return entry_index;
-            }
-            break;
     }
 
-    return 100;
 }
 
-
-static int tiebreaker_IQ(APEX_CPU* cpu, int a, int b){//The lower PC value is the earlier instruction (which in case of tie is issued first) -J
-    //If MEM operation, check the LSQ
-    if(a == 100 && b != 100){
-        return b;
-    }else if(a != 100 && b == 100){
-        return a;
-    }
-    return (cpu->iq[a].pc_value < cpu->iq[b].pc_value) ? a : b;
+/* Stages a multiplier occupies slots for: all of them if pipelined, else one */
+static int
+mul_stages(const APEX_CPU* cpu){
+    return cpu->config.mul_pipelined ? cpu->config.mul_latency : 1;
 }
 
+/*
+ * Returns the exec latch an instruction of fu_type can issue into this
+ * cycle, or -1 if every unit of that type is busy. A pipelined multiplier
+ * takes a new instruction every cycle as long as one of its stage slots is
+ * empty (stage_delay 1 means it already took one this cycle).
+ */
 static int
-free_VFU(APEX_CPU* cpu, int fu_type){
+free_unit(APEX_CPU* cpu, int fu_type){
     switch(fu_type){//Checking VFUs -J
         //Check MUL VFU -J
         case MUL_VFU:
-            if(cpu->mult_exec.has_insn == TRUE){
-                return FALSE;
+            for(int unit = 0; unit < cpu->config.mul_units; unit++){
+                int empty = -1, started = FALSE;
+
+                for(int slot = unit * mul_stages(cpu); slot < (unit + 1) * mul_stages(cpu); slot++){
+                    if(cpu->mult_exec[slot].has_insn == FALSE){
+                        empty = slot;
+                    }else if(cpu->mult_exec[slot].stage_delay == 1){
+                        started = TRUE;
+                    }
+                }
+                if(empty != -1 && !started){
+                    return empty;
+                }
             }
             break;
         //Check INT VFU -J
         case INT_VFU:
-            if(cpu->int_exec.has_insn == TRUE){
-                return FALSE;
+            for(int unit = 0; unit < cpu->config.int_units; unit++){
+                if(cpu->int_exec[unit].has_insn == FALSE && cpu->int_exec[unit].stall == FALSE){
+                    return unit;
+                }
             }
             break;
         //Check BRANCH VFU -J
         case BRANCH_VFU:
-            if(cpu->branch_exec.has_insn == TRUE){
-                return FALSE;
+            if(cpu->branch_exec.has_insn == FALSE){
+                return 0;
             }
             break;
     }
-    return TRUE;
+    return -1;
 }
 
 static void
 APEX_ISSUE_QUEUE(APEX_CPU *cpu){//Will handle grabbing the correct instructions in the IQ for Exec stage -J
-    //I want to make it so there's a comparison between entry
-
-  //print_iq(cpu);
+    //Ready entries whose VFU has a free unit issue oldest first, one per free unit -J
 
-    int entry_index = 100;
-    for(int i = 0; i < 8; i++){
-        if(cpu->iq[i].status_bit == 1 && free_VFU(cpu, cpu->iq[i].fu_type)){//Now check and see if the src_bits are valid (but diff instr wait on diff srcs) -J
+    for(int issued = 0; issued < cpu->config.issue_width; issued++){
+        uint64_t candidates = 0;
+        int entry_index = IQ_NONE;
+        int unit;
 
-            switch(cpu->iq[i].opcode){
-                //First look at instr w/ src1 & src2
-                case OPCODE_ADD:
-                case OPCODE_SUB:
-                case OPCODE_MUL:
-                case OPCODE_AND:
-                case OPCODE_OR:
-                case OPCODE_EXOR:
-                case OPCODE_STORE:
-                case OPCODE_CMP:
-                    // Check if the physical register is valid for both source registers
-                    if(cpu->phys_regs[cpu->iq[i].src1_tag].src_bit && cpu->phys_regs[cpu->iq[i].src2_tag].src_bit){
-                        if(cpu->iq[i].fu_type == INT_VFU){
-                            if(cpu->int_exec.stall == TRUE){
-                                break;
-                            }
-                        }
-                        if(entry_index == 100){
-                            entry_index = i;
-                        }else{
-                            entry_index = tiebreaker_IQ(cpu, entry_index, i);
-                        }
-                    }
-                    break;
-
-                //Look at instr with only src1 -H
-                case OPCODE_ADDL:
-                case OPCODE_SUBL:
-                case OPCODE_LOAD:
-                case OPCODE_JUMP:
-                case OPCODE_RET: //Added this since it has only src1 -C
-                case OPCODE_JALR:
-                    if(cpu->phys_regs[cpu->iq[i].src1_tag].src_bit){
-                        if(cpu->iq[i].fu_type == INT_VFU){
-                            if(cpu->int_exec.stall == TRUE){
-                                break;
-                            }
-                        }
-                        if(entry_index == 100){
-                            entry_index = i;
-                        }else{
-                            entry_index = tiebreaker_IQ(cpu, entry_index, i);
-                        }
-                    }
-                    break;
-
-                //Look at instr with only literals
-                case OPCODE_MOVC:
-                case OPCODE_BP:
-                case OPCODE_BNP:
-                case OPCODE_BZ:
-                case OPCODE_BNZ:
-                case OPCODE_NOP:
-                case OPCODE_HALT:
-                    if(cpu->iq[i].fu_type == INT_VFU){
-                        if(cpu->int_exec.stall == TRUE){
-                            break;
-                        }
-                    }
-                    if(entry_index == 100){
-                        entry_index = i;
-                    }else{
-                        entry_index = tiebreaker_IQ(cpu, entry_index, i);
-                    }
-                    break;
+        for(int fu = 0; fu < NUM_VFU; fu++){
+            if(free_unit(cpu, fu) != -1){
+                candidates |= cpu->iq_fu_mask[fu];
             }
-
-
         }
-    }
+        candidates &= cpu->iq_ready;
 
-   // printf("AAAAAAAA %d\n", entry_index);
-
-    //We have a valid instruction to issue
-    //&& cpu->iq[entry_index].iq_time_padding == 1
-    if(entry_index != 100){
+        if(!candidates){
+            break;
+        }
+        entry_index = iq_oldest(cpu, candidates);
+        unit = free_unit(cpu, cpu->iq[entry_index].fu_type);
 
+        APEX_TRACE(cpu, TRACE_ISSUE, TRACE_LEVEL_DETAIL, "Issue: IQ[%d] pc %d to VFU %d\n",
+                   entry_index, cpu->iq[entry_index].pc_value, cpu->iq[entry_index].fu_type);
 
-        // Remove entry to exetue from IQ and LSQ (if MEM operation)
-        cpu->iq[entry_index].status_bit = 0;
-        IQ_Entry issuing_instr = cpu->iq[entry_index];
-        if(cpu->iq[entry_index].lsq_id != -1){//If we grabbed an MEM op, make sure to adjust LSQ -J
-            cpu->lsq->pop();
-            cpu->iq[entry_index].lsq_id = -1;//Reset lsq_id field for later checks -J
-        }
+        // Remove entry to exetue from IQ, a MEM op keeps its LSQ entry until it commits
+        iq_remove(cpu, entry_index);
+        const IQ_Entry &issuing_instr = cpu->iq[entry_index];
 
         switch (cpu->iq[entry_index].fu_type){
             case MUL_VFU:
-                cpu->mult_exec.pc = issuing_instr.pc_value;
-                cpu->mult_exec.opcode = issuing_instr.opcode;
-                cpu->mult_exec.rs1 = issuing_instr.src1_tag;
-                cpu->mult_exec.rs2 = issuing_instr.src2_tag;
-                cpu->mult_exec.rd = issuing_instr.dest;
-                cpu->mult_exec.rs1_value = issuing_instr.src1_val;
-                cpu->mult_exec.rs2_value = issuing_instr.src2_val;
-                cpu->mult_exec.has_insn = TRUE;
-                cpu->mult_exec.stage_delay = 1;
-                cpu->mult_exec.vfu = MUL_VFU;
+                cpu->mult_exec[unit].pc = issuing_instr.pc_value;
+                cpu->mult_exec[unit].rob_id = issuing_instr.rob_id;
+                cpu->mult_exec[unit].seq = issuing_instr.seq;
+                cpu->mult_exec[unit].opcode = issuing_instr.opcode;
+                cpu->mult_exec[unit].rs1 = issuing_instr.src1_tag;
+                cpu->mult_exec[unit].rs2 = issuing_instr.src2_tag;
+                cpu->mult_exec[unit].rd = issuing_instr.dest;
+                cpu->mult_exec[unit].rs1_value = issuing_instr.src1_val;
+                cpu->mult_exec[unit].rs2_value = issuing_instr.src2_val;
+                cpu->mult_exec[unit].has_insn = TRUE;
+                cpu->mult_exec[unit].stage_delay = 1;
+                cpu->mult_exec[unit].vfu = MUL_VFU;
                 break;
             case INT_VFU:
-                cpu->int_exec.pc = issuing_instr.pc_value;
-                cpu->int_exec.opcode = issuing_instr.opcode;
-                cpu->int_exec.has_insn = TRUE;
-                cpu->int_exec.stall = FALSE;
-                cpu->int_exec.vfu = INT_VFU;
+                cpu->int_exec[unit].pc = issuing_instr.pc_value;
+                cpu->int_exec[unit].rob_id = issuing_instr.rob_id;
+                cpu->int_exec[unit].seq = issuing_instr.seq;
+                cpu->int_exec[unit].opcode = issuing_instr.opcode;
+                cpu->int_exec[unit].has_insn = TRUE;
+                cpu->int_exec[unit].stall = FALSE;
+                cpu->int_exec[unit].vfu = INT_VFU;
                 switch(issuing_instr.opcode){//Break down INT ops based on instruction syntax -J
                     //dest src1 src2 -J
                     case OPCODE_ADD:
@@ -1022,45 +1262,63 @@ APEX_ISSUE_QUEUE(APEX_CPU *cpu){//Will handle grabbing the correct instructions
                     case OPCODE_AND:
                     case OPCODE_OR:
                     case OPCODE_EXOR:
-                        cpu->int_exec.rs1 = issuing_instr.src1_tag;
-                        cpu->int_exec.rs2 = issuing_instr.src2_tag;
-                        cpu->int_exec.rd = issuing_instr.dest;
-                        cpu->int_exec.rs1_value = issuing_instr.src1_val;
-                        cpu->int_exec.rs2_value = issuing_instr.src2_val;
+                        cpu->int_exec[unit].rs1 = issuing_instr.src1_tag;
+                        cpu->int_exec[unit].rs2 = issuing_instr.src2_tag;
+                        cpu->int_exec[unit].rd = issuing_instr.dest;
+                        cpu->int_exec[unit].rs1_value = issuing_instr.src1_val;
+                        cpu->int_exec[unit].rs2_value = issuing_instr.src2_val;
                         break;
 
                     //dest src1 literal -J
                     case OPCODE_ADDL:
                     case OPCODE_SUBL:
                     case OPCODE_LOAD:
-                        cpu->int_exec.rs1 = issuing_instr.src1_tag;
-                        cpu->int_exec.rd = issuing_instr.dest;
-                        cpu->int_exec.imm = issuing_instr.literal;
-                        cpu->int_exec.rs1_value = issuing_instr.src1_val;
+                        cpu->int_exec[unit].rs1 = issuing_instr.src1_tag;
+                        cpu->int_exec[unit].rd = issuing_instr.dest;
+                        cpu->int_exec[unit].imm = issuing_instr.literal;
+                        cpu->int_exec[unit].rs1_value = issuing_instr.src1_val;
 
                         break;
 
                     //src1 src2 literal -J
                     case OPCODE_STORE:
-                        cpu->int_exec.rs1 = issuing_instr.src1_tag;
-                        cpu->int_exec.rs2 = issuing_instr.src2_tag;
-                        cpu->int_exec.imm = issuing_instr.literal;
-                        cpu->int_exec.rs1_value = issuing_instr.src1_val;
-                        cpu->int_exec.rs2_value = issuing_instr.src2_val;
+                        cpu->int_exec[unit].rs1 = issuing_instr.src1_tag;
+                        cpu->int_exec[unit].rs2 = issuing_instr.src2_tag;
+                        cpu->int_exec[unit].imm = issuing_instr.literal;
+                        cpu->int_exec[unit].rs1_value = issuing_instr.src1_val;
+                        cpu->int_exec[unit].rs2_value = issuing_instr.src2_val;
+                        {
+                            LSQ_Entry *lsq_entry = &cpu->lsq[issuing_instr.lsq_id];
+
+                            lsq_entry->data = issuing_instr.src1_val;
+                            lsq_entry->data_tag = issuing_instr.src1_tag;
+                            lsq_entry->data_known = issuing_instr.src1_rdy_bit;
+                        }
+                        if(!issuing_instr.src1_rdy_bit){
+                            //Writeback hands the data to the LSQ entry now, not this slot
+                            vector<int> &consumers = cpu->wakeup[issuing_instr.src1_tag];
+
+                            for(size_t i = 0; i < consumers.size(); i++){
+                                if(consumers[i] == entry_index){
+                                    consumers[i] = WAKEUP_LSQ(issuing_instr.lsq_id);
+                                }
+                            }
+                        }
                         break;
 
                     //dest literal -J
                     case OPCODE_MOVC:
-                        cpu->int_exec.rd = issuing_instr.dest;
-                        cpu->int_exec.imm = issuing_instr.literal;
+                        cpu->int_exec[unit].rd = issuing_instr.dest;
+                        cpu->int_exec[unit].imm = issuing_instr.literal;
                         break;
 
-                    //src1 src2 -H
+                    //src1 src2, dest holds only the flags -H
                     case OPCODE_CMP:
-                        cpu->int_exec.rs1 = issuing_instr.src1_tag;
-                        cpu->int_exec.rs2 = issuing_instr.src2_tag;
-                        cpu->int_exec.rs1_value = issuing_instr.src1_val;
-                        cpu->int_exec.rs2_value = issuing_instr.src2_val;
+                        cpu->int_exec[unit].rd = issuing_instr.dest;
+                        cpu->int_exec[unit].rs1 = issuing_instr.src1_tag;
+                        cpu->int_exec[unit].rs2 = issuing_instr.src2_tag;
+                        cpu->int_exec[unit].rs1_value = issuing_instr.src1_val;
+                        cpu->int_exec[unit].rs2_value = issuing_instr.src2_val;
                         break;
 
                     //Nothing -J
@@ -1070,25 +1328,37 @@ APEX_ISSUE_QUEUE(APEX_CPU *cpu){//Will handle grabbing the correct instructions
                 switch(issuing_instr.opcode){
                     case OPCODE_LOAD:
                     case OPCODE_STORE:
-                        cpu->int_exec.stage_delay = 1;
+                        cpu->int_exec[unit].stage_delay = 1;
                 }
                 break;
 
             case BRANCH_VFU:
                 cpu->branch_exec.pc = issuing_instr.pc_value;
+                cpu->branch_exec.rob_id = issuing_instr.rob_id;
+                cpu->branch_exec.seq = issuing_instr.seq;
                 cpu->branch_exec.opcode = issuing_instr.opcode;
                 cpu->branch_exec.btb_prediciton = issuing_instr.btb_prediciton;
+                cpu->branch_exec.pred_history = issuing_instr.pred_history;
+                cpu->branch_exec.fetch_cycle = issuing_instr.fetch_cycle;
+                cpu->branch_exec.pred_target = issuing_instr.pred_target;
                 cpu->branch_exec.has_insn = TRUE;
                 cpu->branch_exec.vfu = BRANCH_VFU;
 
                 switch(issuing_instr.opcode){
-                    //Only literal -J
+                    //Only literal, plus the zero/positive flags from the flags register -J
                     case OPCODE_BP:
                     case OPCODE_BNP:
                     case OPCODE_BZ:
                     case OPCODE_BNZ:
+                    {
+                        int cc = phys_flags(cpu, issuing_instr.src1_tag);
+
+                        cpu->branch_exec.rs1 = issuing_instr.src1_tag;
                         cpu->branch_exec.imm = issuing_instr.literal;
+                        cpu->branch_exec.rs1_value = (cc & CC_ZERO) ? TRUE : FALSE;
+                        cpu->branch_exec.rs2_value = (cc & CC_POSITIVE) ? TRUE : FALSE;
                         break;
+                    }
                     //Only src1 -C
                     case OPCODE_RET:
                       cpu->branch_exec.rs1 = issuing_instr.src1_tag;
@@ -1110,20 +1380,129 @@ APEX_ISSUE_QUEUE(APEX_CPU *cpu){//Will handle grabbing the correct instructions
                         break;
 
                 }
-                break;
+                break;
+        }
+    }
+}
+/*void IQ_cycle_advancement(APEX_CPU *cpu){
+  for(int i = 0; i < 8; i++){
+    if(cpu->iq[i].status_bit == 1){
+      cpu->iq[i].iq_time_padding = 1;
+    }
+  }
+
+}
+*/
+
+
+/*
+ * Flag writers execute out of order; each one's flags go to the cc bits of
+ * the register they were renamed to, where branches renamed after it read
+ * them. Writeback wakes those branches along with the register's readers.
+ */
+static void
+write_flags(APEX_CPU *cpu, const CPU_Stage &stage, int zero_flag, int positive_flag)
+{
+    cpu->phys_regs[stage.rd].cc = (zero_flag ? CC_ZERO : 0) | (positive_flag ? CC_POSITIVE : 0);
+}
+
+/* Drops a latch's instruction if it is younger than seq */
+static int
+squash_latch(CPU_Stage *stage, unsigned int seq)
+{
+    if(stage->has_insn == TRUE && seq_younger(stage->seq, seq)){
+        stage->has_insn = FALSE;
+        stage->stall = FALSE;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * The branch in the branch unit mispredicted and fetch has been redirected:
+ * drop everything dispatched after it from the IQ, LSQ, ROB and execution
+ * latches, and put the rename map, free list, flags and return stack top
+ * back the way its checkpoint holds them. Nothing younger has written memory, STOREs only
+ * do that from the ROB head. Checkpoints of younger branches go too.
+ */
+static void
+squash_younger(APEX_CPU *cpu, int id)
+{
+    const Branch_Checkpoint *ckpt = &cpu->branch_ckpt[id];
+    uint64_t squashed_slots = 0;
+    int lsq_squashed = FALSE;
+    int squashed = 0;
+
+    for(uint64_t valid = cpu->iq_valid; valid; valid &= valid - 1){
+        int slot = __builtin_ctzll(valid);
+
+        if(seq_younger(cpu->iq[slot].seq, ckpt->seq)){
+            iq_remove(cpu, slot);
+            cpu->iq[slot].lsq_id = -1;
+            squashed_slots |= IQ_BIT(slot);
+        }
+    }
+    //The LSQ is in dispatch order, so its younger entries are all at the tail -J
+    while(cpu->lsq_count &&
+          seq_younger(cpu->lsq[(cpu->lsq_tail + cpu->config.lsq_size - 1) % cpu->config.lsq_size].seq, ckpt->seq)){
+        cpu->lsq_tail = (cpu->lsq_tail + cpu->config.lsq_size - 1) % cpu->config.lsq_size;
+        cpu->lsq_count--;
+        lsq_squashed = TRUE;
+    }
+
+    //Drop squashed slots from the wakeup lists, and issued STOREs whose LSQ entry went with them
+    if(squashed_slots || lsq_squashed){
+        for(int reg = 0; reg < cpu->config.phys_reg_file_size; reg++){
+            vector<int> &consumers = cpu->wakeup[reg];
+            size_t kept = 0;
+
+            for(size_t i = 0; i < consumers.size(); i++){
+                int waiter = consumers[i];
+
+                if(waiter < 0 ? lsq_live(cpu, WAKEUP_LSQ(waiter)) : !(squashed_slots & IQ_BIT(waiter))){
+                    consumers[kept++] = waiter;
+                }
+            }
+            consumers.resize(kept);
         }
     }
-}
-/*void IQ_cycle_advancement(APEX_CPU *cpu){
-  for(int i = 0; i < 8; i++){
-    if(cpu->iq[i].status_bit == 1){
-      cpu->iq[i].iq_time_padding = 1;
+
+    squashed = (cpu->rob_tail - ckpt->rob_tail + cpu->config.rob_size) % cpu->config.rob_size;
+    cpu->rob_tail = ckpt->rob_tail;
+    cpu->rob_count -= squashed;
+
+    for(int slot = 0; slot < cpu->config.mul_units * mul_stages(cpu); slot++){
+        squash_latch(&cpu->mult_exec[slot], ckpt->seq);
     }
-  }
+    for(int unit = 0; unit < cpu->config.mul_units; unit++){
+        squash_latch(&cpu->mult_wb[unit], ckpt->seq);
+    }
+    for(int unit = 0; unit < cpu->config.int_units; unit++){
+        squash_latch(&cpu->int_exec[unit], ckpt->seq);
+        squash_latch(&cpu->int_wb[unit], ckpt->seq);
+    }
+    squash_latch(&cpu->memory, ckpt->seq);
+    squash_latch(&cpu->mem_wb, ckpt->seq);
 
-}
-*/
+    cpu->rename_table = ckpt->map;
+    memcpy(cpu->free_list, &cpu->branch_ckpt_free[id * cpu->free_words],
+           cpu->free_words * sizeof(uint64_t));
+    cpu->free_count = ckpt->free_count;
+    cpu->ras_top = ckpt->ras_top;
+    cpu->ras[(ckpt->ras_top + cpu->config.ras_size - 1) % cpu->config.ras_size] = ckpt->ras_entry;
+
+    for(uint64_t live = cpu->branch_ckpt_live; live; live &= live - 1){
+        int younger = __builtin_ctzll(live);
+
+        if(seq_younger(cpu->branch_ckpt[younger].seq, ckpt->seq)){
+            cpu->branch_ckpt_live &= ~((uint64_t)1 << younger);
+        }
+    }
 
+    cpu->branch_stats.squashed += squashed;
+    APEX_TRACE(cpu, TRACE_EXEC, TRACE_LEVEL_DETAIL, "Branch Exec: squashed %d younger than pc %d\n",
+               squashed, cpu->branch_exec.pc);
+}
 
 /*
  * Execute Stage of APEX Pipeline
@@ -1139,282 +1518,310 @@ APEX_execute(APEX_CPU *cpu)
     /*
         Multiplication section
     */
-    if(cpu->mult_exec.has_insn == TRUE){
-        printf("Mult Exec: %d\n", cpu->mult_exec.opcode);
-        if(cpu->mult_exec.stage_delay > 2){
-            switch (cpu->mult_exec.opcode){
-                case OPCODE_MUL:
-                {
-                    cpu->mult_exec.result_buffer
-                        = cpu->mult_exec.rs1_value * cpu->mult_exec.rs2_value;
-
-                    /* Set the zero flag based on the result buffer */
-                    if (cpu->mult_exec.result_buffer == 0) {
-                        cpu->zero_flag = TRUE;
-                    } else {
-                        cpu->zero_flag = FALSE;
-                    }
+    //Every slot of every multiplier, a pipelined unit has one per stage -J
+    int mult_busy = FALSE;
+    for(int slot = 0; slot < cpu->config.mul_units * mul_stages(cpu); slot++){
+        CPU_Stage *mult = &cpu->mult_exec[slot];
+
+        if(mult->has_insn == TRUE){
+            mult_busy = TRUE;
+            APEX_TRACE(cpu, TRACE_EXEC, TRACE_LEVEL_STAGE, "Mult Exec: %d\n", mult->opcode);
+            if(mult->stage_delay >= cpu->code_memory[get_code_memory_index_from_pc(mult->pc)].latency){
+                int zero_flag = FALSE, positive_flag = FALSE;
+
+                switch (mult->opcode){
+                    case OPCODE_MUL:
+                    {
+                        mult->result_buffer
+                            = mult->rs1_value * mult->rs2_value;
+
+                        /* Set the zero flag based on the result buffer */
+                        if (mult->result_buffer == 0) {
+                            zero_flag = TRUE;
+                        } else {
+                            zero_flag = FALSE;
+                        }
 
-                    // Set the positive flag based on the result buffer
-                    if(cpu->mult_exec.result_buffer > 0){
-                        cpu->positive_flag = TRUE;
-                    }else{
-                        cpu->positive_flag = FALSE;
+                        // Set the positive flag based on the result buffer
+                        if(mult->result_buffer > 0){
+                            positive_flag = TRUE;
+                        }else{
+                            positive_flag = FALSE;
+                        }
+                        break;
                     }
-                    break;
                 }
+                write_flags(cpu, *mult, zero_flag, positive_flag);
+                cpu->mult_wb[slot / mul_stages(cpu)] = *mult;
+                mult->has_insn = FALSE;
+            } else{
+                // Increment cyle delay counter
+                mult->stage_delay++;
             }
-            cpu->mult_wb = cpu->mult_exec;
-            cpu->mult_exec.has_insn = FALSE;
-        } else{
-            // Increment cyle delay counter
-            cpu->mult_exec.stage_delay++;
-        }
 
-    } else printf("Mult Int:\n");
+        }
+    }
+    if(!mult_busy) APEX_TRACE(cpu, TRACE_EXEC, TRACE_LEVEL_STAGE, "Mult Int:\n");
 
     /*
         Integer section
         Check if there is a valid instruction to process, since memory instructions take 2 cycles in the memory stage we need to check for stalls -H
     */
 
-    if(cpu->int_exec.has_insn == TRUE && cpu->int_exec.stall == FALSE){
-        int mem_instruction = FALSE;
-
-        printf("Int Exec: %d\n", cpu->int_exec.opcode);
-        switch (cpu->int_exec.opcode){
-            case OPCODE_ADD:
-            {
-                cpu->int_exec.result_buffer
-                    = cpu->int_exec.rs1_value + cpu->int_exec.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->int_exec.result_buffer == 0) {
-                    cpu->zero_flag = TRUE;
-                } else {
-                    cpu->zero_flag = FALSE;
-                }
+    int int_busy = FALSE;
+    for(int unit = 0; unit < cpu->config.int_units; unit++){
+        CPU_Stage *alu = &cpu->int_exec[unit];
 
-                // Set the positive flag based on the result buffer
-                if(cpu->int_exec.result_buffer > 0){
-                    cpu->positive_flag = TRUE;
-                } else{
-                    cpu->positive_flag = FALSE;
-                }
-                break;
-            }
-            case OPCODE_ADDL:
-            {
-                cpu->int_exec.result_buffer
-                    = cpu->int_exec.rs1_value + cpu->int_exec.imm;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->int_exec.result_buffer == 0) {
-                    cpu->zero_flag = TRUE;
-                } else {
-                    cpu->zero_flag = FALSE;
-                }
+        if(alu->has_insn == TRUE && alu->stall == FALSE){
+            int mem_instruction = FALSE;
+            int_busy = TRUE;
+            int zero_flag = FALSE, positive_flag = FALSE;
 
-                // Set the positive flag based on the result buffer
-                if(cpu->int_exec.result_buffer > 0){
-                    cpu->positive_flag = TRUE;
-                } else{
-                    cpu->positive_flag = FALSE;
-                }
-                break;
-            }
+            APEX_TRACE(cpu, TRACE_EXEC, TRACE_LEVEL_STAGE, "Int Exec: %d\n", alu->opcode);
+            switch (alu->opcode){
+                case OPCODE_ADD:
+                {
+                    alu->result_buffer
+                        = alu->rs1_value + alu->rs2_value;
 
-            case OPCODE_SUB:
-            {
-                cpu->int_exec.result_buffer
-                    = cpu->int_exec.rs1_value - cpu->int_exec.rs2_value;
+                    /* Set the zero flag based on the result buffer */
+                    if (alu->result_buffer == 0) {
+                        zero_flag = TRUE;
+                    } else {
+                        zero_flag = FALSE;
+                    }
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->int_exec.result_buffer == 0) {
-                    cpu->zero_flag = TRUE;
-                } else
-                {
-                    cpu->zero_flag = FALSE;
+                    // Set the positive flag based on the result buffer
+                    if(alu->result_buffer > 0){
+                        positive_flag = TRUE;
+                    } else{
+                        positive_flag = FALSE;
+                    }
+                    break;
                 }
+                case OPCODE_ADDL:
+                {
+                    alu->result_buffer
+                        = alu->rs1_value + alu->imm;
 
-                // Set the positive flag based on the result buffer
-                if(cpu->int_exec.result_buffer > 0){
-                    cpu->positive_flag = TRUE;
-                } else{
-                    cpu->positive_flag = FALSE;
-                }
-                break;
-            }
+                    /* Set the zero flag based on the result buffer */
+                    if (alu->result_buffer == 0) {
+                        zero_flag = TRUE;
+                    } else {
+                        zero_flag = FALSE;
+                    }
 
-            case OPCODE_SUBL:
-            {
-                cpu->int_exec.result_buffer
-                    = cpu->int_exec.rs1_value - cpu->int_exec.imm;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->int_exec.result_buffer == 0) {
-                    cpu->zero_flag = TRUE;
-                } else {
-                    cpu->zero_flag = FALSE;
+                    // Set the positive flag based on the result buffer
+                    if(alu->result_buffer > 0){
+                        positive_flag = TRUE;
+                    } else{
+                        positive_flag = FALSE;
+                    }
+                    break;
                 }
 
-                // Set the positive flag based on the result buffer
-                if(cpu->int_exec.result_buffer > 0){
-                    cpu->positive_flag = TRUE;
-                } else{
-                    cpu->positive_flag = FALSE;
-                }
-                break;
-            }
+                case OPCODE_SUB:
+                {
+                    alu->result_buffer
+                        = alu->rs1_value - alu->rs2_value;
 
-            case OPCODE_AND:
-            {
-                cpu->int_exec.result_buffer
-                    = cpu->int_exec.rs1_value & cpu->int_exec.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->int_exec.result_buffer == 0) {
-                    cpu->zero_flag = TRUE;
-                } else {
-                    cpu->zero_flag = FALSE;
-                }
+                    /* Set the zero flag based on the result buffer */
+                    if (alu->result_buffer == 0) {
+                        zero_flag = TRUE;
+                    } else
+                    {
+                        zero_flag = FALSE;
+                    }
 
-                // Set the positive flag based on the result buffer
-                if(cpu->int_exec.result_buffer > 0){
-                    cpu->positive_flag = TRUE;
-                } else{
-                    cpu->positive_flag = FALSE;
+                    // Set the positive flag based on the result buffer
+                    if(alu->result_buffer > 0){
+                        positive_flag = TRUE;
+                    } else{
+                        positive_flag = FALSE;
+                    }
+                    break;
                 }
-                break;
-            }
 
-            case OPCODE_OR:
-            {
-                    cpu->int_exec.result_buffer
-                        = cpu->int_exec.rs1_value | cpu->int_exec.rs2_value;
+                case OPCODE_SUBL:
+                {
+                    alu->result_buffer
+                        = alu->rs1_value - alu->imm;
 
                     /* Set the zero flag based on the result buffer */
-                    if (cpu->int_exec.result_buffer == 0) {
-                        cpu->zero_flag = TRUE;
+                    if (alu->result_buffer == 0) {
+                        zero_flag = TRUE;
                     } else {
-                        cpu->zero_flag = FALSE;
+                        zero_flag = FALSE;
                     }
 
                     // Set the positive flag based on the result buffer
-                    if(cpu->int_exec.result_buffer > 0){
-                        cpu->positive_flag = TRUE;
+                    if(alu->result_buffer > 0){
+                        positive_flag = TRUE;
                     } else{
-                        cpu->positive_flag = FALSE;
+                        positive_flag = FALSE;
                     }
                     break;
-            }
+                }
 
-            case OPCODE_EXOR:
-            {
-                    cpu->int_exec.result_buffer
-                        = cpu->int_exec.rs1_value ^ cpu->int_exec.rs2_value;
+                case OPCODE_AND:
+                {
+                    alu->result_buffer
+                        = alu->rs1_value & alu->rs2_value;
 
                     /* Set the zero flag based on the result buffer */
-                    if (cpu->int_exec.result_buffer == 0) {
-                        cpu->zero_flag = TRUE;
+                    if (alu->result_buffer == 0) {
+                        zero_flag = TRUE;
                     } else {
-                        cpu->zero_flag = FALSE;
+                        zero_flag = FALSE;
                     }
 
                     // Set the positive flag based on the result buffer
-                    if(cpu->int_exec.result_buffer > 0){
-                        cpu->positive_flag = TRUE;
+                    if(alu->result_buffer > 0){
+                        positive_flag = TRUE;
                     } else{
-                        cpu->positive_flag = FALSE;
+                        positive_flag = FALSE;
                     }
                     break;
-            }
+                }
 
-            case OPCODE_MOVC:
-            {
-                cpu->int_exec.result_buffer = cpu->int_exec.imm;
+                case OPCODE_OR:
+                {
+                        alu->result_buffer
+                            = alu->rs1_value | alu->rs2_value;
+
+                        /* Set the zero flag based on the result buffer */
+                        if (alu->result_buffer == 0) {
+                            zero_flag = TRUE;
+                        } else {
+                            zero_flag = FALSE;
+                        }
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->int_exec.result_buffer == 0) {
-                    cpu->zero_flag = TRUE;
-                } else {
-                    cpu->zero_flag = FALSE;
+                        // Set the positive flag based on the result buffer
+                        if(alu->result_buffer > 0){
+                            positive_flag = TRUE;
+                        } else{
+                            positive_flag = FALSE;
+                        }
+                        break;
                 }
 
-                // Set the positive flag based on the result buffer
-                if(cpu->int_exec.result_buffer > 0){
-                    cpu->positive_flag = TRUE;
-                } else{
-                    cpu->positive_flag = FALSE;
+                case OPCODE_EXOR:
+                {
+                        alu->result_buffer
+                            = alu->rs1_value ^ alu->rs2_value;
+
+                        /* Set the zero flag based on the result buffer */
+                        if (alu->result_buffer == 0) {
+                            zero_flag = TRUE;
+                        } else {
+                            zero_flag = FALSE;
+                        }
+
+                        // Set the positive flag based on the result buffer
+                        if(alu->result_buffer > 0){
+                            positive_flag = TRUE;
+                        } else{
+                            positive_flag = FALSE;
+                        }
+                        break;
                 }
-                break;
-            }
-            case OPCODE_CMP:
-            {
-                // Set the zero flag if the 2 components in the source registers are equal
-                if(cpu->int_exec.rs1_value == cpu->int_exec.rs2_value){
-                    cpu->zero_flag = TRUE;
-                } else{
-                    cpu->zero_flag = FALSE;
+
+                case OPCODE_MOVC:
+                {
+                    alu->result_buffer = alu->imm;
+
+                    /* Set the zero flag based on the result buffer */
+                    if (alu->result_buffer == 0) {
+                        zero_flag = TRUE;
+                    } else {
+                        zero_flag = FALSE;
+                    }
+
+                    // Set the positive flag based on the result buffer
+                    if(alu->result_buffer > 0){
+                        positive_flag = TRUE;
+                    } else{
+                        positive_flag = FALSE;
+                    }
+                    break;
+                }
+                case OPCODE_CMP:
+                {
+                    // Set the zero flag if the 2 components in the source registers are equal
+                    if(alu->rs1_value == alu->rs2_value){
+                        zero_flag = TRUE;
+                    } else{
+                        zero_flag = FALSE;
+                    }
+
+                    // Set the positive flag if the value in source register 1 is greater than the value in source register 2
+                    if(alu->rs1_value > alu->rs2_value){
+                        positive_flag = TRUE;
+                    } else{
+                        positive_flag = FALSE;
+                    }
+                    break;
                 }
 
-                // Set the positive flag if the value in source register 1 is greater than the value in source register 2
-                if(cpu->int_exec.rs1_value > cpu->int_exec.rs2_value){
-                    cpu->positive_flag = TRUE;
-                } else{
-                    cpu->positive_flag = FALSE;
+                // LOAD <dest> <src2> <literal> -H
+                case OPCODE_LOAD:
+                {
+                    mem_instruction = TRUE;
+                    alu->memory_address
+                        = alu->rs1_value + alu->imm;
+                    break;
                 }
-                break;
-            }
 
-            // LOAD <dest> <src2> <literal> -H
-            case OPCODE_LOAD:
-            {
-                mem_instruction = TRUE;
-                cpu->int_exec.memory_address
-                    = cpu->int_exec.rs1_value + cpu->int_exec.imm;
-                break;
+                // STORE <src1> <src2> <literal> -H
+                case OPCODE_STORE:
+                {
+                    mem_instruction = TRUE;
+                    alu->memory_address
+                        = alu->rs2_value + alu->imm;
+                    break;
+                }
             }
 
-            // STORE <src1> <src2> <literal> -H
-            case OPCODE_STORE:
-            {
-                mem_instruction = TRUE;
-                cpu->int_exec.memory_address
-                    = cpu->int_exec.rs2_value + cpu->int_exec.imm;
-                break;
+            if(cpu->code_memory[get_code_memory_index_from_pc(alu->pc)].flags & INSN_SETS_FLAGS){
+                write_flags(cpu, *alu, zero_flag, positive_flag);
             }
-        }
 
-        if(mem_instruction == TRUE){
+            if(mem_instruction == TRUE){
+                // The LSQ entry holds it from here until APEX_memory picks it, the unit is free again -J
+                LSQ_Entry *entry = lsq_find(cpu, alu->seq);
+
+                entry->address = alu->memory_address;
+                entry->addr_known = TRUE;
+                if(entry->opcode == OPCODE_STORE){
+                    lsq_store_known(cpu, entry);
+                }
+                alu->has_insn = FALSE;
+                alu->stall = FALSE;
+            } else{
+                cpu->int_wb[unit] = *alu;
+                alu->has_insn = FALSE;
+                alu->stall = FALSE;
 
-            // Memory instructions require 2 cycles, therefore we need to stall if a second memory instruction immedietly follows another -H
-            if(cpu->memory.has_insn == TRUE) {
-                cpu->int_exec.stall = TRUE;
-            } else {
-                // If there is no instruction currently in the mem stage advance current instruction to next stage -H
-                cpu->memory = cpu->int_exec; //Memory has its own stage
-                cpu->int_exec.has_insn = FALSE;
-                cpu->int_exec.stall = FALSE;
             }
-        } else{
-            cpu->int_wb = cpu->int_exec;
-            cpu->int_exec.has_insn = FALSE;
-            cpu->int_exec.stall = FALSE;
 
         }
-
-    } else printf("Int Exec:\n");
+    }
+    if(!int_busy) APEX_TRACE(cpu, TRACE_EXEC, TRACE_LEVEL_STAGE, "Int Exec:\n");
     /*
         Branch section -H
     */
     if(cpu->branch_exec.has_insn == TRUE){
-          printf("Branch Exec:%d\n",cpu->branch_exec.opcode);
+          int predicted = cpu->branch_exec.btb_prediciton;
+          int zero_flag = cpu->branch_exec.rs1_value, positive_flag = cpu->branch_exec.rs2_value;
+          int ckpt = find_branch_ckpt(cpu, cpu->branch_exec.seq);
+          int mispredicted = FALSE;
+
+          APEX_TRACE(cpu, TRACE_EXEC, TRACE_LEVEL_STAGE, "Branch Exec:%d\n",cpu->branch_exec.opcode);
             switch(cpu->branch_exec.opcode){
               case OPCODE_BZ:
                 {
                     // If zero flag is true, then branch should be taken. -H
-                    if (cpu->zero_flag == TRUE)
+                    if (zero_flag == TRUE)
                     {
                         /* Check predicition. If branch was already taken predicition was correct continue without any action.
                             Otherwise bad predicition, revert PC to the instruction PC+imm and flush all previous stages. -H
@@ -1428,8 +1835,7 @@ APEX_execute(APEX_CPU *cpu)
                             cpu->fetch_from_next_cycle = TRUE;
 
                             // Flush all previous stages -H
-                            cpu->decode2.has_insn = FALSE;
-                            cpu->decode1.has_insn = FALSE;
+                            flush_front_end(cpu);
 
                             // Make sure fetch stage is enabled to start fetching from new PC -H
                             cpu->fetch.has_insn = TRUE;
@@ -1453,8 +1859,7 @@ APEX_execute(APEX_CPU *cpu)
                             cpu->fetch_from_next_cycle = TRUE;
 
                             // Flush all previous stages -H
-                            cpu->decode2.has_insn = FALSE;
-                            cpu->decode1.has_insn = FALSE;
+                            flush_front_end(cpu);
 
                             // Make sure fetch stage is enabled to start fetching from new PC -H
                             cpu->fetch.has_insn = TRUE;
@@ -1465,10 +1870,6 @@ APEX_execute(APEX_CPU *cpu)
 
                     }
 
-                    // Set branch outcome in BTB for next predicition -H
-                    cpu->btb[0].valid = TRUE;
-                    cpu->btb[0].outcome = cpu->branch_exec.btb_prediciton;
-
                     break;
                 }
 
@@ -1476,7 +1877,7 @@ APEX_execute(APEX_CPU *cpu)
                 {
 
                     // If zero flag is false, then branch should be taken. -H
-                    if (cpu->zero_flag == FALSE)
+                    if (zero_flag == FALSE)
                     {
                         /* Check predicition. If branch was already taken predicition was correct continue without any action.
                             Otherwise bad predicition, revert PC to the instruction PC+imm and flush all previous stages. -H
@@ -1490,8 +1891,7 @@ APEX_execute(APEX_CPU *cpu)
                             cpu->fetch_from_next_cycle = TRUE;
 
                             // Flush all previous stages -H
-                            cpu->decode2.has_insn = FALSE;
-                            cpu->decode1.has_insn = FALSE;
+                            flush_front_end(cpu);
 
                             // Make sure fetch stage is enabled to start fetching from new PC -H
                             cpu->fetch.has_insn = TRUE;
@@ -1515,8 +1915,7 @@ APEX_execute(APEX_CPU *cpu)
                             cpu->fetch_from_next_cycle = TRUE;
 
                             // Flush all previous stages -H
-                            cpu->decode2.has_insn = FALSE;
-                            cpu->decode1.has_insn = FALSE;
+                            flush_front_end(cpu);
 
                             // Make sure fetch stage is enabled to start fetching from new PC -H
                             cpu->fetch.has_insn = TRUE;
@@ -1527,17 +1926,13 @@ APEX_execute(APEX_CPU *cpu)
 
                     }
 
-                    // Set branch outcome in BTB for next predicition -H
-                    cpu->btb[1].valid = TRUE;
-                    cpu->btb[1].outcome = cpu->branch_exec.btb_prediciton;
-
                     break;
                 }
 
                 case OPCODE_BP:
                 {
                     // If positive flag is true, then branch should be taken. -H
-                    if (cpu->positive_flag == TRUE)
+                    if (positive_flag == TRUE)
                     {
                         /* Check predicition. If branch was already taken predicition was correct continue without any action.
                             Otherwise bad predicition, revert PC to the instruction PC+imm and flush all previous stages. -H
@@ -1551,8 +1946,7 @@ APEX_execute(APEX_CPU *cpu)
                             cpu->fetch_from_next_cycle = TRUE;
 
                             // Flush all previous stages -H
-                            cpu->decode2.has_insn = FALSE;
-                            cpu->decode1.has_insn = FALSE;
+                            flush_front_end(cpu);
 
                             // Make sure fetch stage is enabled to start fetching from new PC -H
                             cpu->fetch.has_insn = TRUE;
@@ -1576,8 +1970,7 @@ APEX_execute(APEX_CPU *cpu)
                             cpu->fetch_from_next_cycle = TRUE;
 
                             // Flush all previous stages -H
-                            cpu->decode2.has_insn = FALSE;
-                            cpu->decode1.has_insn = FALSE;
+                            flush_front_end(cpu);
 
                             // Make sure fetch stage is enabled to start fetching from new PC -H
                             cpu->fetch.has_insn = TRUE;
@@ -1588,17 +1981,13 @@ APEX_execute(APEX_CPU *cpu)
 
                     }
 
-                    // Set branch outcome in BTB for next predicition -H
-                    cpu->btb[2].valid = TRUE;
-                    cpu->btb[2].outcome = cpu->branch_exec.btb_prediciton;
-
                     break;
                 }
 
                 case OPCODE_BNP:
                 {
                     // If positive flag is false, then branch should be taken. -H
-                    if (cpu->positive_flag == FALSE)
+                    if (positive_flag == FALSE)
                     {
                         /* Check predicition. If branch was already taken predicition was correct continue without any action.
                             Otherwise bad predicition, revert PC to the instruction PC+imm and flush all previous stages. -H
@@ -1612,8 +2001,7 @@ APEX_execute(APEX_CPU *cpu)
                             cpu->fetch_from_next_cycle = TRUE;
 
                             // Flush all previous stages -H
-                            cpu->decode2.has_insn = FALSE;
-                            cpu->decode1.has_insn = FALSE;
+                            flush_front_end(cpu);
 
                             // Make sure fetch stage is enabled to start fetching from new PC -H
                             cpu->fetch.has_insn = TRUE;
@@ -1637,8 +2025,7 @@ APEX_execute(APEX_CPU *cpu)
                             cpu->fetch_from_next_cycle = TRUE;
 
                             // Flush all previous stages -H
-                            cpu->decode2.has_insn = FALSE;
-                            cpu->decode1.has_insn = FALSE;
+                            flush_front_end(cpu);
 
                             // Make sure fetch stage is enabled to start fetching from new PC -H
                             cpu->fetch.has_insn = TRUE;
@@ -1649,36 +2036,253 @@ APEX_execute(APEX_CPU *cpu)
 
                     }
 
-                    // Set branch outcome in BTB for next predicition -H
-                    cpu->btb[3].valid = TRUE;
-                    cpu->btb[3].outcome = cpu->branch_exec.btb_prediciton;
-
                     break;
                 }
 
                 case OPCODE_JALR:
                 {
 
-                    // JALR is always taken, therefore it was taken in the decode 1 stage. However, we need to store the caclulated result in the destination register -H
+                    // JALR is always taken, therefore it was taken in the decode 1 stage (or fetch). However, we need to store the caclulated result in the destination register -H
+                    int target = cpu->branch_exec.rs1_value + cpu->branch_exec.imm;
+
                     cpu->branch_exec.result_buffer = cpu->branch_exec.pc + 4;
+                    APEX_itc_update(cpu, cpu->branch_exec.pc, cpu->branch_exec.pred_history, target);
+                    if (cpu->branch_exec.pred_target < 0) {
+                        break;
+                    }
+                    cpu->branch_stats.indirect_predicted++;
+                    if (target != cpu->branch_exec.pred_target) {
+                        cpu->branch_stats.indirect_mispredicted++;
+                        indirect_mispredict(cpu, target);
+                        mispredicted = TRUE;
+                    }
                     break;
                 }
 
-                // JUMP/RET is always taken, therefore it was taken in the decode 1 stage and no action is required -H
                 case OPCODE_JUMP:
+                {
+                    // Fetch followed the target cache when it hit, check it against the register -J
+                    int target = cpu->branch_exec.rs1_value + cpu->branch_exec.imm;
+
+                    APEX_itc_update(cpu, cpu->branch_exec.pc, cpu->branch_exec.pred_history, target);
+                    if (cpu->branch_exec.pred_target < 0) {
+                        break;
+                    }
+                    cpu->branch_stats.indirect_predicted++;
+                    if (target != cpu->branch_exec.pred_target) {
+                        cpu->branch_stats.indirect_mispredicted++;
+                        indirect_mispredict(cpu, target);
+                        mispredicted = TRUE;
+                    }
+                    break;
+                }
+
                 case OPCODE_RET:
+                {
+                    // Fetch followed the return stack, check it against the register -J
+                    if (cpu->branch_exec.pred_target < 0) {
+                        break;
+                    }
+                    cpu->branch_stats.returns_predicted++;
+                    if (cpu->branch_exec.rs1_value != cpu->branch_exec.pred_target) {
+                        cpu->branch_stats.returns_mispredicted++;
+                        indirect_mispredict(cpu, cpu->branch_exec.rs1_value);
+                        mispredicted = TRUE;
+                    }
+                    break;
+                }
+
                 case OPCODE_HALT:
                   break;
         }
 
+        if(cpu->code_memory[get_code_memory_index_from_pc(cpu->branch_exec.pc)].flags & INSN_COND_BRANCH){
+            // Set branch outcome in BTB and predictor for next predicition -H
+            APEX_btb_update(cpu, cpu->branch_exec.pc, cpu->branch_exec.btb_prediciton,
+                            cpu->branch_exec.pc + cpu->branch_exec.imm);
+            APEX_predictor_update(cpu, cpu->branch_exec.pc, cpu->branch_exec.pred_history,
+                                  cpu->branch_exec.btb_prediciton);
+
+            cpu->branch_stats.resolved++;
+            if (cpu->branch_exec.btb_prediciton != predicted)
+            {
+                mispredicted = TRUE;
+                cpu->branch_stats.mispredicted++;
+                cpu->branch_stats.flush_cycles += cpu->clock - cpu->branch_exec.fetch_cycle;
+                APEX_TRACE(cpu, TRACE_EXEC, TRACE_LEVEL_DETAIL, "Branch Exec: mispredict pc %d, fetch redirected to %d\n",
+                           cpu->branch_exec.pc, cpu->pc);
+            }
+        }
+
+        // Recovery is one step from the checkpoint, fetch restarts next cycle -J
+        if(ckpt != -1){
+            if(mispredicted){
+                squash_younger(cpu, ckpt);
+            }
+            cpu->branch_ckpt_live &= ~((uint64_t)1 << ckpt);
+        }
+
         cpu->branch_wb = cpu->branch_exec;
         cpu->branch_exec.has_insn = FALSE;
 
-    } else printf("Branch Exec:\n");
+    } else APEX_TRACE(cpu, TRACE_EXEC, TRACE_LEVEL_STAGE, "Branch Exec:\n");
+
+
+
+
+}
+
+/*
+ * Where the LOAD in LSQ entry id gets its data: the youngest older STORE
+ * to the same address, or memory (-1) once every older STORE is known to
+ * write elsewhere. -2 while an older STORE that could match has no address
+ * yet. *older_stores counts the older STOREs it looked past.
+ */
+static int
+lsq_load_source(const APEX_CPU *cpu, int id, int *older_stores)
+{
+    const LSQ_Entry *load = &cpu->lsq[id];
+
+    *older_stores = 0;
+    while(id != cpu->lsq_head){
+        id = (id + cpu->config.lsq_size - 1) % cpu->config.lsq_size;
+        if(cpu->lsq[id].opcode != OPCODE_STORE){
+            continue;
+        }
+        if(!cpu->lsq[id].addr_known){
+            return -2;
+        }
+        if(cpu->lsq[id].address == load->address){
+            return id;
+        }
+        (*older_stores)++;
+    }
+    return -1;
+}
+
+/* The youngest committed STORE to address still in the store buffer, -1 if none */
+static int
+store_buffer_find(const APEX_CPU *cpu, int address)
+{
+    for(int n = 0, id = cpu->sb_tail; n < cpu->sb_count; n++){
+        id = (id + cpu->config.store_buffer_size - 1) % cpu->config.store_buffer_size;
+        if(cpu->store_buffer[id].address == address){
+            return id;
+        }
+    }
+    return -1;
+}
+
+/* Sends the oldest buffered STORE to the memory stage, it leaves the buffer once written */
+static void
+store_buffer_drain(APEX_CPU *cpu)
+{
+    const Store_Buffer_Entry *entry = &cpu->store_buffer[cpu->sb_head];
+
+    cpu->memory.pc = entry->pc;
+    cpu->memory.opcode = OPCODE_STORE;
+    cpu->memory.seq = entry->seq;
+    cpu->memory.rob_id = -1;
+    cpu->memory.memory_address = entry->address;
+    cpu->memory.rs1_value = entry->data;
+    cpu->memory.vfu = INT_VFU;
+    cpu->memory.stall = FALSE;
+    cpu->memory.stage_delay = 1;
+    cpu->memory.has_insn = TRUE;
+}
+
+/* Latch contents for an LSQ entry leaving for the memory stage or mem_wb */
+static void
+lsq_to_stage(const LSQ_Entry *entry, CPU_Stage *stage)
+{
+    stage->pc = entry->pc;
+    stage->opcode = entry->opcode;
+    stage->seq = entry->seq;
+    stage->rob_id = entry->rob_id;
+    stage->rd = entry->dest;
+    stage->memory_address = entry->address;
+    stage->rs1_value = entry->data;
+    stage->vfu = INT_VFU;
+    stage->stall = FALSE;
+    stage->stage_delay = 1;
+    stage->has_insn = TRUE;
+}
 
+/*
+ * Picks what enters an idle memory stage: the oldest LOAD that can read
+ * memory past the older STOREs in the LSQ and the store buffer, or else the
+ * oldest buffered STORE. A full store buffer drains first so commit is not
+ * held up behind LOADs.
+ */
+static void
+lsq_issue_memory(APEX_CPU *cpu)
+{
+    if(cpu->sb_count == cpu->config.store_buffer_size){
+        store_buffer_drain(cpu);
+        return;
+    }
+    for(int n = 0, id = cpu->lsq_head; n < cpu->lsq_count; n++, id = (id + 1) % cpu->config.lsq_size){
+        LSQ_Entry *entry = &cpu->lsq[id];
+        int older_stores;
 
+        if(entry->opcode != OPCODE_LOAD || !entry->addr_known || entry->issued ||
+           lsq_load_source(cpu, id, &older_stores) != -1 || store_buffer_find(cpu, entry->address) != -1){
+            continue;
+        }
+        lsq_to_stage(entry, &cpu->memory);
+        entry->issued = TRUE;
+        cpu->lsq_stats.loads++;
+        if(older_stores){
+            cpu->lsq_stats.bypassed++;
+        }
+        APEX_TRACE(cpu, TRACE_MEM, TRACE_LEVEL_DETAIL, "Memory: LOAD pc %d reads %d past %d older STOREs\n",
+                   entry->pc, entry->address, older_stores);
+        return;
+    }
+    if(cpu->sb_count){
+        store_buffer_drain(cpu);
+    }
+}
 
+/*
+ * The oldest LOAD an older STORE has the data for skips memory, one per
+ * cycle. STOREs in the LSQ are younger than the buffered ones, so they are
+ * searched first.
+ */
+static void
+lsq_forward(APEX_CPU *cpu)
+{
+    for(int n = 0, id = cpu->lsq_head; n < cpu->lsq_count; n++, id = (id + 1) % cpu->config.lsq_size){
+        LSQ_Entry *entry = &cpu->lsq[id];
+        int older_stores, store, from_buffer;
 
+        if(entry->opcode != OPCODE_LOAD || !entry->addr_known || entry->issued){
+            continue;
+        }
+        store = lsq_load_source(cpu, id, &older_stores);
+        from_buffer = (store == -1);
+        if(from_buffer){
+            store = store_buffer_find(cpu, entry->address);
+            if(store == -1){
+                continue;
+            }
+        }else if(store < 0 || !cpu->lsq[store].data_known){
+            continue;
+        }
+        lsq_to_stage(entry, &cpu->mem_wb);
+        cpu->mem_wb.result_buffer = from_buffer ? cpu->store_buffer[store].data : cpu->lsq[store].data;
+        entry->issued = TRUE;
+        cpu->lsq_stats.loads++;
+        if(from_buffer){
+            cpu->lsq_stats.buffered++;
+        }else{
+            cpu->lsq_stats.forwarded++;
+        }
+        APEX_TRACE(cpu, TRACE_MEM, TRACE_LEVEL_DETAIL, "Memory: LOAD pc %d forwarded %d from STORE pc %d\n",
+                   entry->pc, cpu->mem_wb.result_buffer,
+                   from_buffer ? cpu->store_buffer[store].pc : cpu->lsq[store].pc);
+        return;
+    }
 }
 
 /*
@@ -1689,18 +2293,25 @@ APEX_execute(APEX_CPU *cpu)
 static void
 APEX_memory(APEX_CPU *cpu)
 {
+    if (cpu->memory.has_insn == FALSE)
+    {
+        lsq_issue_memory(cpu);
+    }
+
     if (cpu->memory.has_insn == TRUE)
     {
-      printf("Memory:%d\n", cpu->memory.opcode);
+      APEX_TRACE(cpu, TRACE_MEM, TRACE_LEVEL_STAGE, "Memory:%d\n", cpu->memory.opcode);
         if(cpu->memory.stage_delay > 1){
 
             switch (cpu->memory.opcode)
             {
                 case OPCODE_LOAD:
                 {
-                    /* Read from data memory */
+                    /* Read from data memory, a wrong-path LOAD may have any address */
+                    int address = cpu->memory.memory_address;
+
                     cpu->memory.result_buffer
-                        = cpu->data_memory[cpu->memory.memory_address];
+                        = (address >= 0 && address < DATA_MEMORY_SIZE) ? cpu->data_memory[address] : 0;
                     cpu->mem_wb = cpu->memory;
                     cpu->memory.has_insn = FALSE;
                     break;
@@ -1711,29 +2322,29 @@ APEX_memory(APEX_CPU *cpu)
                     /*Write data into memory*/
                     cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
 
-                    // Since the STORE instruction doesn't require the WB stage set the ROB entry valid bit so it can commit -H
-                    for(auto it = cpu->rob->begin(); it != cpu->rob->end(); it++){
-
-                        if(cpu->memory.pc == it->pc_value){
-                            it->status_bit = 1;
-                        }
-                    }
+                    // Only committed STOREs get here, from the store buffer head
+                    cpu->sb_head = (cpu->sb_head + 1) % cpu->config.store_buffer_size;
+                    cpu->sb_count--;
+                    cpu->lsq_stats.drained++;
 
-                    cpu->memory.has_insn = FALSE; //Last stop for a STORE, goes straight to commitment -J
+                    cpu->memory.has_insn = FALSE;
                     break;
                 }
             }
 
-            // The mem instruction is complete, check if another mem operation is being stalled in exe stage -H
-            cpu->int_exec.stall = FALSE;
-
         }else{
 
             cpu->memory.stage_delay++;
 
         }
 
-    } else   printf("Memory:\n");
+    } else   APEX_TRACE(cpu, TRACE_MEM, TRACE_LEVEL_STAGE, "Memory:\n");
+
+    //mem_wb is free unless a LOAD just left the memory stage -J
+    if (cpu->mem_wb.has_insn == FALSE)
+    {
+        lsq_forward(cpu);
+    }
 }
 
 /*
@@ -1742,7 +2353,7 @@ APEX_memory(APEX_CPU *cpu)
  * Note: You are free to edit this function according to your implementation
  */
 static void
-APEX_forward(APEX_CPU* cpu, CPU_Stage forward){//This is where we'll forward the data to all relevant data structures -J
+APEX_forward(APEX_CPU* cpu, const CPU_Stage &forward){//This is where we'll forward the data to all relevant data structures -J
     //Only forward instr that has a dest reg -J
     switch(forward.opcode){
         case OPCODE_ADD:
@@ -1756,31 +2367,51 @@ APEX_forward(APEX_CPU* cpu, CPU_Stage forward){//This is where we'll forward the
         case OPCODE_EXOR:
         case OPCODE_MUL:
         case OPCODE_JALR:
-            //Loop through iq and match rd to rs1 or rs2 and fill in and set ready bit -J
-            for(int i = 0; i < 8; i++){
-                if(cpu->iq[i].status_bit == 1){
-                    if(cpu->iq[i].src1_tag == forward.rd){
+        case OPCODE_CMP:
+        {
+            //Only the IQ slots that registered on this tag in decode2 need to be visited,
+            //and the STOREs that issued ahead of their data pick it up in the LSQ
+            vector<int> &consumers = cpu->wakeup[forward.rd];
+
+            for(size_t i = 0; i < consumers.size(); i++){
+                if(consumers[i] < 0){
+                    LSQ_Entry *store = &cpu->lsq[WAKEUP_LSQ(consumers[i])];
+
+                    store->data = forward.result_buffer;
+                    store->data_known = TRUE;
+                    lsq_store_known(cpu, store);
+                    continue;
+                }
+                IQ_Entry *entry = &cpu->iq[consumers[i]];
 
-                        cpu->iq[i].src1_val = forward.result_buffer;
-                        cpu->iq[i].src1_rdy_bit = 1;
+                if(entry->status_bit == 1){
+                    if(entry->src1_tag == forward.rd){
+
+                        entry->src1_val = forward.result_buffer;
+                        entry->src1_rdy_bit = 1;
                     }
-                    if(cpu->iq[i].src2_tag == forward.rd){
+                    if(entry->src2_tag == forward.rd){
 
-                        cpu->iq[i].src2_val = forward.result_buffer;
-                        cpu->iq[i].src2_rdy_bit = 1;
+                        entry->src2_val = forward.result_buffer;
+                        entry->src2_rdy_bit = 1;
+                    }
+                    if(iq_operands_ready(entry)){
+                        cpu->iq_ready |= IQ_BIT(consumers[i]);
                     }
 
                 }
             }
-            //Do the same for ROB
-            for(auto it = cpu->rob->begin(); it != cpu->rob->end(); it++){
+            consumers.clear();
 
-                if(forward.pc == it->pc_value){
-                    it->status_bit = 1;
-                    it->result = forward.result_buffer;
-                }
-            }
+            cpu->rob[forward.rob_id].status_bit = 1;
+            cpu->rob[forward.rob_id].result = forward.result_buffer;
+
+            cpu->phys_regs[forward.rd].value = forward.result_buffer;
+            cpu->phys_regs[forward.rd].src_bit = 1;
+            APEX_TRACE(cpu, TRACE_WB, TRACE_LEVEL_DETAIL, "Forward: P%d = %d (pc %d)\n",
+                       forward.rd, forward.result_buffer, forward.pc);
             break;
+        }
 
         //ADD OTHER BRANCHES HERE -J
         case OPCODE_HALT:
@@ -1791,113 +2422,146 @@ APEX_forward(APEX_CPU* cpu, CPU_Stage forward){//This is where we'll forward the
         case OPCODE_BNP:
         case OPCODE_RET:
         case OPCODE_JUMP:
-        case OPCODE_CMP:
-            for(auto it = cpu->rob->begin(); it != cpu->rob->end(); it++){
-                if(forward.pc == it->pc_value){
-                    it->status_bit = 1;
-                }
-            }
+            cpu->rob[forward.rob_id].status_bit = 1;
             break;
     }
-
-        cpu->phys_regs[forward.rd].value = forward.result_buffer;
-        cpu->phys_regs[forward.rd].src_bit = 1;
-
-
 }
 static void
 APEX_writeback(APEX_CPU *cpu)
 {
 
-    //Handling forwarding write backs -J
-    if(cpu->mult_wb.has_insn == TRUE){
-        APEX_forward(cpu, cpu->mult_wb);
-        cpu->rename_table[CC_INDEX].phys_reg_id = cpu->mult_wb.rd;
-        cpu->mult_wb.has_insn = FALSE;
-        printf("Mult WB: %d\n", cpu->mult_wb.opcode);
+    //Handling forwarding write backs, one port per unit -J
+    int mult_done = 0, int_done = 0;
 
-    } else printf("Mult WB:\n");
+    for(int unit = 0; unit < cpu->config.mul_units; unit++){
+        if(cpu->mult_wb[unit].has_insn == TRUE){
+            APEX_forward(cpu, cpu->mult_wb[unit]);
+            cpu->mult_wb[unit].has_insn = FALSE;
+            APEX_TRACE(cpu, TRACE_WB, TRACE_LEVEL_STAGE, "Mult WB: %d\n", cpu->mult_wb[unit].opcode);
+            mult_done++;
+        }
+    }
+    if(!mult_done) APEX_TRACE(cpu, TRACE_WB, TRACE_LEVEL_STAGE, "Mult WB:\n");
     // Int operations writeback stage -H
-    if(cpu->int_wb.has_insn == TRUE){
-        APEX_forward(cpu, cpu->int_wb);
-        cpu->rename_table[CC_INDEX].phys_reg_id = cpu->mult_wb.rd;
-        cpu->int_wb.has_insn = FALSE;
-        printf("Int WB: %d\n", cpu->int_wb.opcode);
-    } else printf("Int WB:\n");
+    for(int unit = 0; unit < cpu->config.int_units; unit++){
+        if(cpu->int_wb[unit].has_insn == TRUE){
+            APEX_forward(cpu, cpu->int_wb[unit]);
+            cpu->int_wb[unit].has_insn = FALSE;
+            APEX_TRACE(cpu, TRACE_WB, TRACE_LEVEL_STAGE, "Int WB: %d\n", cpu->int_wb[unit].opcode);
+            int_done++;
+        }
+    }
+    if(!int_done) APEX_TRACE(cpu, TRACE_WB, TRACE_LEVEL_STAGE, "Int WB:\n");
     if(cpu->mem_wb.has_insn == TRUE){
         APEX_forward(cpu, cpu->mem_wb);
-        switch(cpu->mem_wb.opcode){
-            case OPCODE_LOAD:
-                cpu->rename_table[CC_INDEX].phys_reg_id = cpu->mult_wb.rd;
-            break;
-        }
         cpu->mem_wb.has_insn = FALSE;
-        printf("MEM WB: %d\n", cpu->mem_wb.opcode);
+        APEX_TRACE(cpu, TRACE_WB, TRACE_LEVEL_STAGE, "MEM WB: %d\n", cpu->mem_wb.opcode);
     }
     if(cpu->branch_wb.has_insn == TRUE){
         APEX_forward(cpu, cpu->branch_wb);
-
-        switch(cpu->branch_wb.opcode){
-
-            case OPCODE_JALR:
-                cpu->rename_table[CC_INDEX].phys_reg_id = cpu->branch_wb.rd;
-
-                // Reset branch flag and stall -H
-                cpu->branch_flag = FALSE;
-                cpu->fetch.stall = FALSE;
-                break;
-        }
-          printf("Branch WB: %d \n", cpu->branch_wb.opcode);
+          APEX_TRACE(cpu, TRACE_WB, TRACE_LEVEL_STAGE, "Branch WB: %d \n", cpu->branch_wb.opcode);
 
         cpu->branch_wb.has_insn = FALSE;
-    } else printf("Branch WB:\n");
+    } else APEX_TRACE(cpu, TRACE_WB, TRACE_LEVEL_STAGE, "Branch WB:\n");
 
 
     /* Default */
     return;
 }
 
+/*
+ * Retires up to commit_width consecutive completed entries from the ROB head,
+ * stopping early at an --insns limit, and records what ended the cycle's
+ * commit in cpu->commit_stats. Returns 1 once HALT reaches the head.
+ */
 static int
 APEX_commitment(APEX_CPU* cpu){
-    if(!cpu->rob->empty()){
-
-        ROB_Entry rob_entry = cpu->rob->front();
-        if(rob_entry.status_bit == 1){
-            cpu->rob->pop_front();
-
-            switch (rob_entry.opcode){
-                case OPCODE_ADD:
-                case OPCODE_LOAD:
-                case OPCODE_MOVC:
-                case OPCODE_ADDL:
-                case OPCODE_SUB:
-                case OPCODE_SUBL:
-                case OPCODE_AND:
-                case OPCODE_OR:
-                case OPCODE_EXOR:
-                case OPCODE_MUL:
-                case OPCODE_JALR:
-                    /* For instructions with destination register: -H
-                        - Write contents back into argitectural register
-                        - Free up the physical register
-                    */
-                    cpu->arch_regs[rob_entry.ar_addr].value = rob_entry.result;
-                    cpu->arch_regs[rob_entry.ar_addr].src_bit = 1;
-                    cpu->free_list->push(cpu->rename_table[rob_entry.ar_addr].phys_reg_id);
-                    //printf("%d RESULT = %d\n", rob_entry.pc_value, rob_entry.result); // Useful for debugging results, so I'm leaving it in -J
-                    break;
-                case OPCODE_HALT:
-                    return 1;
-            }
+    int retired = 0;
 
-            cpu->insn_completed++;
+    while(retired < cpu->config.commit_width && cpu->rob_count &&
+          !(cpu->insn_limit > 0 && cpu->insn_completed >= cpu->insn_limit)){
 
+        ROB_Entry rob_entry = cpu->rob[cpu->rob_head];
+        if(rob_entry.status_bit != 1){
+            break;
+        }
+        //A STORE needs a store buffer slot, and HALT waits for the buffer to reach memory
+        if((rob_entry.opcode == OPCODE_STORE && cpu->sb_count == cpu->config.store_buffer_size) ||
+           (rob_entry.opcode == OPCODE_HALT && cpu->sb_count)){
+            cpu->lsq_stats.buffer_full++;
+            break;
+        }
+        cpu->rob_head = (cpu->rob_head + 1) % cpu->config.rob_size;
+        cpu->rob_count--;
+        APEX_TRACE(cpu, TRACE_COMMIT, TRACE_LEVEL_STAGE, "Commit: %s (pc %d)\n",
+                   APEX_opcode_name(rob_entry.opcode), rob_entry.pc_value);
 
+        switch (rob_entry.opcode){
+            case OPCODE_ADD:
+            case OPCODE_LOAD:
+            case OPCODE_MOVC:
+            case OPCODE_ADDL:
+            case OPCODE_SUB:
+            case OPCODE_SUBL:
+            case OPCODE_AND:
+            case OPCODE_OR:
+            case OPCODE_EXOR:
+            case OPCODE_MUL:
+            case OPCODE_JALR:
+                /* For instructions with destination register: -H
+                    - Write contents back into argitectural register
+                    - Free up the physical register
+                */
+                cpu->arch_regs[rob_entry.ar_addr].value = rob_entry.result;
+                cpu->arch_regs[rob_entry.ar_addr].src_bit = 1;
+                // Nothing younger can name the mapping this instruction replaced -J
+                if(rob_entry.prev_phys_reg != -1){
+                    release_phys_reg(cpu, rob_entry.prev_phys_reg);
+                }
+                //printf("%d RESULT = %d\n", rob_entry.pc_value, rob_entry.result); // Useful for debugging results, so I'm leaving it in -J
+                break;
+            case OPCODE_HALT:
+                cpu->commit_stats.retired[retired]++;
+                return 1;
+        }
+        if(rob_entry.flags_reg != -1){
+            //Architectural flags, and the flags mapping it replaced goes like the register's -J
+            cpu->zero_flag = (cpu->phys_regs[rob_entry.flags_reg].cc & CC_ZERO) ? TRUE : FALSE;
+            cpu->positive_flag = (cpu->phys_regs[rob_entry.flags_reg].cc & CC_POSITIVE) ? TRUE : FALSE;
+            if(rob_entry.prev_flags_reg != -1){
+                release_phys_reg(cpu, rob_entry.prev_flags_reg);
+            }
+        }
+        if(rob_entry.opcode == OPCODE_STORE){
+            const LSQ_Entry *store = &cpu->lsq[cpu->lsq_head];
+            Store_Buffer_Entry *buffered = &cpu->store_buffer[cpu->sb_tail];
+
+            buffered->pc = store->pc;
+            buffered->seq = store->seq;
+            buffered->address = store->address;
+            buffered->data = store->data;
+            cpu->sb_tail = (cpu->sb_tail + 1) % cpu->config.store_buffer_size;
+            cpu->sb_count++;
         }
+        if(rob_entry.opcode == OPCODE_LOAD || rob_entry.opcode == OPCODE_STORE){
+            //Oldest memory op, so the LSQ head -J
+            cpu->lsq_head = (cpu->lsq_head + 1) % cpu->config.lsq_size;
+            cpu->lsq_count--;
+        }
+
+        cpu->insn_completed++;
+        retired++;
     }
-    if (ENABLE_DEBUG_MESSAGES) {
-    std::cout<<"Commit: " << cpu->commitment.opcode_str << std::endl;
+
+    cpu->commit_stats.retired[retired]++;
+    if(!cpu->rob_count){
+        cpu->commit_stats.rob_empty++;
+    }else if(cpu->rob[cpu->rob_head].status_bit != 1){
+        cpu->commit_stats.head_incomplete++;
+    }else if(retired == cpu->config.commit_width){
+        cpu->commit_stats.width_limited++;
     }
+    if(!retired) APEX_TRACE(cpu, TRACE_COMMIT, TRACE_LEVEL_STAGE, "Commit:\n");
     return 0;
 }
 /*
@@ -1906,7 +2570,7 @@ APEX_commitment(APEX_CPU* cpu){
  * Note: You are free to edit this function according to your implementation
  */
 APEX_CPU *
-APEX_cpu_init(const char *filename)
+APEX_cpu_init(const char *filename, const APEX_Config *config, int batch_mode)
 {
     int i;
     APEX_CPU *cpu;
@@ -1922,19 +2586,43 @@ APEX_cpu_init(const char *filename)
         return NULL;
     }
 
+    /* Microarchitecture sizes are fixed for the lifetime of the CPU */
+    cpu->config = *config;
+    cpu->phys_regs = (RF_Entry *) calloc(config->phys_reg_file_size, sizeof(RF_Entry));
+    cpu->iq = (IQ_Entry *) calloc(config->iq_size, sizeof(IQ_Entry));
+    if (!cpu->phys_regs || !cpu->iq)
+    {
+        free(cpu->phys_regs);
+        free(cpu->iq);
+        free(cpu);
+        return NULL;
+    }
+
     /* Initialize PC, Registers and all pipeline stages */
     cpu->pc = 4000;
+    cpu->batch_mode = batch_mode;
+
+    /* Interactive runs show every stage each cycle, batch runs trace nothing
+     * unless asked to through APEX_cpu_set_trace() */
+    if (batch_mode)
+    {
+        trace_init(&cpu->trace, 0, TRACE_LEVEL_OFF, 0);
+    }
+    else
+    {
+        trace_init(&cpu->trace, TRACE_ALL, TRACE_LEVEL_STAGE, TRACE_DEFAULT_BUFFER_SIZE);
+    }
     //Initialize reg files
     for(i = 0; i < REG_FILE_SIZE; i++){
         cpu->arch_regs[i].value = 0;
         cpu->arch_regs[i].src_bit = 0;
     }
-    for(i = 0; i < PHYS_REG_FILE_SIZE; i++){
+    for(i = 0; i < cpu->config.phys_reg_file_size; i++){
         cpu->phys_regs[i].value = 0;
         cpu->phys_regs[i].src_bit = 0;
     }
     for(i = 0; i < REG_FILE_SIZE+1; i++){
-        cpu->rename_table[i].phys_reg_id = -1;
+        cpu->rename_table.phys[i] = -1;
     }
 
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
@@ -1943,10 +2631,32 @@ APEX_cpu_init(const char *filename)
     cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
     if (!cpu->code_memory)
     {
+        trace_free(&cpu->trace);
+        free(cpu->phys_regs);
+        free(cpu->iq);
         free(cpu);
         return NULL;
     }
-    if (ENABLE_DEBUG_MESSAGES)
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        /* The pipeline has no divider; refuse DIV rather than deadlock on it */
+        if (cpu->code_memory[i].opcode == OPCODE_DIV)
+        {
+            fprintf(stderr, "APEX_Error: DIV at pc %d is not supported\n", 4000 + 4 * i);
+            free(cpu->code_memory);
+            trace_free(&cpu->trace);
+            free(cpu->phys_regs);
+            free(cpu->iq);
+            free(cpu);
+            return NULL;
+        }
+        /* Multiplier latency is a property of the configured units */
+        if (cpu->code_memory[i].vfu == MUL_VFU)
+        {
+            cpu->code_memory[i].latency = cpu->config.mul_latency;
+        }
+    }
+    if (ENABLE_DEBUG_MESSAGES && !cpu->batch_mode)
     {
         fprintf(stderr,
                 "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
@@ -1958,7 +2668,7 @@ APEX_cpu_init(const char *filename)
 
         for (i = 0; i < cpu->code_memory_size; ++i)
         {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
+            printf("%-9s %-9d %-9d %-9d %-9d\n", APEX_opcode_name(cpu->code_memory[i].opcode),
                    cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
                    cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
         }
@@ -1970,27 +2680,42 @@ APEX_cpu_init(const char *filename)
     cpu->clock = 1;
 
     /*Initialization Additions*/
-    //Setting delays for MULT and MEM (only stages with delays) -J
-    cpu->mult_exec.stage_delay = 1;
+    //Setting delays for MEM (MUL slots get theirs at issue) -J
     cpu->memory.stage_delay = 1;
 
-    //Make sure has_insn is False for all initial vfu checks
-    cpu->mult_exec.has_insn = FALSE;
-    cpu->int_exec.has_insn = FALSE;
+    //Make sure has_insn is False for all initial vfu checks (the unit arrays are calloc'd)
     cpu->branch_exec.has_insn = FALSE;
     cpu->memory.has_insn = FALSE;
 
-    cpu->free_list = new queue<int>;
-    cpu->rob = new list<ROB_Entry>;
-    cpu->lsq = new queue<IQ_Entry>;
-
-    for(i = 0; i < 20; i++){//Setting up free list
-
-        cpu->free_list->push(i);
+    cpu->free_words = (cpu->config.phys_reg_file_size + 63) / 64;
+    cpu->free_list = new uint64_t[cpu->free_words]();
+    cpu->free_count = 0;
+    cpu->branch_ckpt = new Branch_Checkpoint[cpu->config.branch_checkpoints]();
+    cpu->branch_ckpt_free = new uint64_t[cpu->config.branch_checkpoints * cpu->free_words]();
+    cpu->branch_ckpt_live = 0;
+    cpu->wakeup = new vector<int>[cpu->config.phys_reg_file_size];
+    cpu->rob = new ROB_Entry[cpu->config.rob_size];
+    cpu->rob_head = 0;
+    cpu->rob_tail = 0;
+    cpu->rob_count = 0;
+    cpu->lsq = new LSQ_Entry[cpu->config.lsq_size]();
+    cpu->lsq_head = 0;
+    cpu->lsq_tail = 0;
+    cpu->lsq_count = 0;
+    cpu->store_buffer = new Store_Buffer_Entry[cpu->config.store_buffer_size]();
+    cpu->sb_head = 0;
+    cpu->sb_tail = 0;
+    cpu->sb_count = 0;
+
+    for(i = 0; i < cpu->config.phys_reg_file_size; i++){//Setting up free list
+
+        free_phys_reg(cpu, i);
 
     }
 
-    for(i = 0; i < 8; i++){
+    cpu->iq_slots = (cpu->config.iq_size == MAX_IQ_SIZE) ? ~(uint64_t)0
+                                                         : IQ_BIT(cpu->config.iq_size) - 1;
+    for(i = 0; i < cpu->config.iq_size; i++){
         IQ_Entry iq_entry;
         iq_entry.status_bit = 0;
         //iq_entry.iq_time_padding = 0;
@@ -2002,17 +2727,61 @@ APEX_cpu_init(const char *filename)
         iq_entry.pc_value = INT_MAX; //For the tiebreakers later on
         cpu->iq[i] = iq_entry;
     }
-    //Don't need to init LSQ or ROB bc they are both dynamically sized data structures -J
+    //Don't need to init LSQ bc it is a dynamically sized data structure, the ROB ring starts empty -J
 
     // Default all instructions in BTB to invalid -H
-    for (i = 0; i < 4; i++) {
-        cpu->btb[i].valid = FALSE;
+    cpu->btb = new BTB_Entry[APEX_btb_entries(&cpu->config)]();
+    cpu->pred_table = new int16_t[APEX_predictor_entries(&cpu->config)];
+    APEX_predictor_reset(cpu);
+    for(i = 0; i < MAX_RAS_SIZE; i++){
+        cpu->ras[i] = -1;
+    }
+    cpu->ras_top = 0;
+    cpu->itc = new ITC_Entry[cpu->config.itc_size];
+    for(i = 0; i < cpu->config.itc_size; i++){
+        cpu->itc[i].tag = -1;
     }
 
+    cpu->initial_state = new vector<uint8_t>;
+    APEX_checkpoint_save(cpu, *cpu->initial_state);
+
     return cpu;
 }
 
 
+/*
+ * Hands the architectural state left by APEX_functional_run() to the
+ * pipeline, which must not have run yet: architectural register i becomes
+ * physical register i holding its value (the free list hands out the lowest
+ * registers first) and the rest stay free. Returns -1 if there are not more
+ * physical than architectural registers.
+ */
+int
+APEX_cpu_switch_over(APEX_CPU *cpu)
+{
+    if (cpu->config.phys_reg_file_size <= REG_FILE_SIZE)
+    {
+        fprintf(stderr, "APEX_Error: switch-over needs more than %d physical registers\n",
+                REG_FILE_SIZE);
+        return -1;
+    }
+
+    for (int i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        int reg = alloc_phys_reg(cpu);
+
+        cpu->phys_regs[reg].value = cpu->arch_regs[i].value;
+        cpu->phys_regs[reg].src_bit = 1;
+        cpu->phys_regs[reg].maps++;
+        cpu->rename_table.phys[i] = reg;
+    }
+
+    /* Fetch resumes where the interpreter stopped */
+    cpu->fetch.has_insn = cpu->halted ? FALSE : TRUE;
+    cpu->fetch.stall = FALSE;
+    return 0;
+}
+
 /*
  * APEX CPU simulation loop
  *
@@ -2028,18 +2797,28 @@ APEX_cpu_run(APEX_CPU *cpu)
      * mem_address_wanted != -1 means show_mem
      * Otherwise it is display or simulate
      */
+    double host_start = host_time();
+
+    cpu->started_over = FALSE; //Only a STARTOVER inside the loop skips a clock advance
     while (1)
     {
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d \t PC #: %d\n", cpu->clock, cpu->pc);
-            printf("--------------------------------------------\n");
-        }
+        APEX_TRACE(cpu, TRACE_CYCLE, TRACE_LEVEL_STAGE,
+                   "--------------------------------------------\n"
+                   "Clock Cycle #: %d \t PC #: %d\n"
+                   "--------------------------------------------\n",
+                   cpu->clock, cpu->pc);
 
         if (APEX_commitment(cpu)){
             /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            cpu->halted = TRUE;
+            if (!cpu->batch_mode)
+            {
+                trace_flush(&cpu->trace);
+            }
+            if (!cpu->batch_mode)
+            {
+                printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            }
             break;
         }
         APEX_writeback(cpu);
@@ -2048,6 +2827,12 @@ APEX_cpu_run(APEX_CPU *cpu)
         APEX_decode2(cpu);
         APEX_decode1(cpu);
         APEX_fetch(cpu);
+        /* Interactive runs show the stages every cycle, batch runs keep
+         * the ring as a record of the last cycles and dump it at the end */
+        if (!cpu->batch_mode)
+        {
+            trace_flush(&cpu->trace);
+        }
        //print_reg_file(cpu);
         //print_phys_reg_file(cpu);
         //print_rename_table(cpu);
@@ -2060,7 +2845,6 @@ APEX_cpu_run(APEX_CPU *cpu)
             //scanf("%c", &user_prompt_val);
             //std::cin >> user_val;
             getline(std::cin, user_val);
-            std::stringstream s(user_val);
 
             if ((user_val == "Q") || (user_val == "q"))
             {
@@ -2071,24 +2855,133 @@ APEX_cpu_run(APEX_CPU *cpu)
 
               //IF THE USER_VAL DOESN'T MAP TO A VALID COMMAND, IT WILL JUST IGNORE THIS
               APEX_command(cpu, user_val);
-            } /*else if (user_val == "SHOWREGS" || user_val == "SHOWIQ" ||
-            user_val == "SHOWROB" || user_val == "SHOWMEM" || user_val == "SHOWBTB" ||
-          user_val == "STOP" || user_val == "SHOWRNT" || user_val == "RUN" || (s >> user_val) ) {
-              //printf("HEY");
-              cpu->command = user_val;
-              APEX_command(cpu, cpu->command);
+            }
 
-            }*/
+        } else if (cpu->num_actions) {
+            APEX_run_actions(cpu);
+        }
 
-        } else {
-            APEX_command(cpu,cpu->command);
+        /* STOP or a RUN limit ends this CPU's run, not the process */
+        if (cpu->stop_requested)
+        {
+            if (!cpu->batch_mode)
+            {
+                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            }
+            break;
         }
 
 
 
 
+        /* The restored load-time clock is the next cycle to simulate */
+        if (cpu->started_over)
+        {
+            cpu->started_over = FALSE;
+            continue;
+        }
+
+        /* Batch runs stop here instead of waiting on a RUN command */
+        if ((cpu->cycle_limit > 0 && cpu->clock >= cpu->cycle_limit) ||
+            (cpu->insn_limit > 0 && cpu->insn_completed >= cpu->insn_limit))
+        {
+            if (!cpu->batch_mode)
+            {
+                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            }
+            break;
+        }
+
         cpu->clock++;
     }
+
+    cpu->host_seconds += host_time() - host_start;
+}
+
+/* Cycles by what stopped commit, then by how many entries retired */
+static void
+print_commit_stats(const APEX_CPU *cpu)
+{
+    const APEX_Commit_Stats *stats = &cpu->commit_stats;
+
+    printf("Commit stalls: width %ld, head not complete %ld, ROB empty %ld cycles\n",
+           stats->width_limited, stats->head_incomplete, stats->rob_empty);
+    printf("Retired per cycle:");
+    for (int n = 0; n <= cpu->config.commit_width; ++n)
+    {
+        printf(" %d:%ld", n, stats->retired[n]);
+    }
+    printf("\n");
+}
+
+static void
+print_branch_stats(const APEX_CPU *cpu)
+{
+    const APEX_Branch_Stats *stats = &cpu->branch_stats;
+
+    printf("Branches (%s): %ld resolved, %ld mispredicted (%.2f%%), %ld flush cycles, %ld squashed\n",
+           APEX_predictor_name(cpu->config.predictor), stats->resolved, stats->mispredicted,
+           stats->resolved ? 100.0 * stats->mispredicted / stats->resolved : 0.0,
+           stats->flush_cycles, stats->squashed);
+    printf("Returns: %ld predicted by the return stack, %ld mispredicted\n",
+           stats->returns_predicted, stats->returns_mispredicted);
+    printf("Indirect jumps: %ld predicted by the target cache, %ld mispredicted\n",
+           stats->indirect_predicted, stats->indirect_mispredicted);
+}
+
+static void
+print_lsq_stats(const APEX_CPU *cpu)
+{
+    const APEX_LSQ_Stats *stats = &cpu->lsq_stats;
+
+    printf("Loads: %ld, %ld forwarded from an older store, %ld read memory past older stores\n",
+           stats->loads, stats->forwarded, stats->bypassed);
+    printf("Store buffer: %ld stores drained, %ld loads forwarded, %ld commit stall cycles\n",
+           stats->drained, stats->buffered, stats->buffer_full);
+}
+
+/*
+ * Final report for batch runs: one block per program instead of the
+ * per-cycle pipeline trace.
+ */
+void
+APEX_cpu_print_summary(const APEX_CPU *cpu)
+{
+    double host_seconds = cpu->host_seconds;
+
+    printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+           cpu->halted ? "Complete" : "Stopped", cpu->clock, cpu->insn_completed);
+    printf("IPC = %.3f\n", cpu->clock ? (double)cpu->insn_completed / cpu->clock : 0.0);
+    if (cpu->ffwd_insns)
+    {
+        printf("Fast-forwarded %ld instructions before the detailed run\n", cpu->ffwd_insns);
+    }
+    print_commit_stats(cpu);
+    print_branch_stats(cpu);
+    print_lsq_stats(cpu);
+    if (host_seconds > 0)
+    {
+        printf("Host time = %.3f s, %.0f simulated cycles/s\n", host_seconds,
+               cpu->clock / host_seconds);
+    }
+    print_reg_file(cpu);
+}
+
+/*
+ * Replaces the default trace settings. Batch runs keep the last
+ * buffer_size bytes and write them to sink when the CPU is stopped. A sink
+ * other than stdout belongs to the CPU from here and is closed then.
+ */
+void
+APEX_cpu_set_trace(APEX_CPU *cpu, unsigned int mask, int level, size_t buffer_size, FILE *sink)
+{
+    trace_flush(&cpu->trace);
+    trace_free(&cpu->trace);
+    trace_init(&cpu->trace, mask, level, buffer_size);
+    if (sink)
+    {
+        cpu->trace.sink = sink;
+    }
 }
 
 /*
@@ -2099,106 +2992,189 @@ APEX_cpu_run(APEX_CPU *cpu)
 void
 APEX_cpu_stop(APEX_CPU *cpu)
 {
-    delete(cpu->free_list);
-    delete(cpu->rob);
-    delete(cpu->lsq);
+    trace_flush(&cpu->trace);
+    trace_free(&cpu->trace);
+    delete[](cpu->free_list);
+    delete[](cpu->branch_ckpt);
+    delete[](cpu->branch_ckpt_free);
+    delete[](cpu->wakeup);
+    delete[](cpu->rob);
+    delete[](cpu->btb);
+    delete[](cpu->pred_table);
+    delete[](cpu->itc);
+    delete[](cpu->lsq);
+    delete[](cpu->store_buffer);
+    delete(cpu->initial_state);
 
     free(cpu->code_memory);
+    free(cpu->phys_regs);
+    free(cpu->iq);
     //free(cpu->filename);
     free(cpu);
 }
 
+/*
+ * Turns one command (already split into tokens) into an action. SHOW
+ * commands take an optional trailing cycle number and then only fire on
+ * that cycle, e.g. "SHOWROB 40" or "SHOWMEM 0 16 40".
+ */
+static int
+parse_action(const std::vector<std::string> &tok, APEX_Action *action)
+{
+    static const struct
+    {
+        const char *name;
+        int type;
+    } show_commands[] = {
+        {"SHOWREGS", ACTION_SHOW_REGS}, {"SHOWRNT", ACTION_SHOW_RNT},
+        {"SHOWIQ", ACTION_SHOW_IQ},     {"SHOWROB", ACTION_SHOW_ROB},
+        {"SHOWBTB", ACTION_SHOW_BTB},   {"SHOWLSQ", ACTION_SHOW_LSQ},
+    };
+
+    action->cycle = ACTION_EVERY_CYCLE;
+    action->start = 0;
+    action->end = 0;
+
+    if (tok[0] == "RUN" && tok.size() == 2)
+    {
+        action->type = ACTION_RUN_UNTIL;
+        action->cycle = atoi(tok[1].c_str());
+        return TRUE;
+    }
+
+    if (tok[0] == "SHOWMEM" && (tok.size() == 3 || tok.size() == 4))
+    {
+        action->type = ACTION_SHOW_MEM;
+        action->start = atoi(tok[1].c_str());
+        action->end = atoi(tok[2].c_str());
+        if (action->start < 0 || action->end >= DATA_MEMORY_SIZE)
+        {
+            return FALSE;
+        }
+        if (tok.size() == 4)
+        {
+            action->cycle = atoi(tok[3].c_str());
+        }
+        return TRUE;
+    }
+
+    for (size_t i = 0; i < sizeof(show_commands) / sizeof(show_commands[0]); ++i)
+    {
+        if (tok[0] == show_commands[i].name && tok.size() <= 2)
+        {
+            action->type = show_commands[i].type;
+            if (tok.size() == 2)
+            {
+                action->cycle = atoi(tok[1].c_str());
+            }
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Evaluates the parsed command actions for the current cycle. Called every
+ * cycle when not single stepping, so it only does integer compares.
+ */
+static void
+APEX_run_actions(APEX_CPU *cpu)
+{
+    for (int i = 0; i < cpu->num_actions; ++i)
+    {
+        const APEX_Action *action = &cpu->actions[i];
+
+        if (action->cycle != ACTION_EVERY_CYCLE && action->cycle != cpu->clock)
+        {
+            continue;
+        }
+
+        switch (action->type)
+        {
+            case ACTION_RUN_UNTIL:
+                cpu->stop_requested = TRUE;
+                break;
+            case ACTION_SHOW_REGS:
+                print_reg_file(cpu);
+                print_phys_reg_file(cpu);
+                break;
+            case ACTION_SHOW_RNT:
+                print_rename_table(cpu);
+                break;
+            case ACTION_SHOW_IQ:
+                print_iq(cpu);
+                break;
+            case ACTION_SHOW_ROB:
+                print_rob(cpu);
+                break;
+            case ACTION_SHOW_BTB:
+                print_btb(cpu);
+                break;
+            case ACTION_SHOW_LSQ:
+                print_lsq(cpu);
+                break;
+            case ACTION_SHOW_MEM:
+                print_mem(cpu, action->start, action->end);
+                break;
+        }
+    }
+}
+
+/*
+ * Parses a user command line once into cpu->actions and runs it for the
+ * current cycle. Several commands can be given separated by ';', e.g.
+ * "RUN 200; SHOWMEM 0 16 150". STEP, STOP and STARTOVER act immediately
+ * and are not kept.
+ */
 void
 APEX_command(APEX_CPU *cpu, std::string  user_in)
 {
+  std::stringstream commands(user_in);
+  std::string command;
 
-  std::vector<std::string> tok;
-  std::stringstream ss(user_in);
-  std::string buffer;
-  cpu->command = user_in;
+  cpu->num_actions = 0;
 
+  while (getline(commands, command, ';'))
+  {
+    std::vector<std::string> tok;
+    std::stringstream ss(command);
+    std::string buffer;
 
     while (ss >> buffer){
       tok.push_back(buffer);
     }
 
+    if (tok.empty())
+    {
+      continue;
+    }
 
     if (tok.size() == 1) {
       std::string s1 = tok.at(0);
-      if (s1 == ("SHOWREGS")){
-        print_reg_file(cpu);
-        print_phys_reg_file(cpu);
-      }
-      else if (s1 == ("SHOWRNT")) {
-        print_rename_table(cpu);
-      }
-      else if (s1 == "SHOWIQ") {
-        print_iq(cpu);
-      }
-      else if (s1 == "SHOWROB"){
-        print_rob(cpu);
-      }
-      else if (s1 == "SHOWBTB") {
-        print_btb(cpu);
-      }
-      else if (s1 == "SHOWLSQ") {
-        print_lsq(cpu);
-      } else if (s1 == "STEP") {
+      if (s1 == "STEP") {
         cpu->single_step = 1;
+        continue;
       }
       else if (s1 == "STOP")
       {
-        exit(1);
+        cpu->stop_requested = TRUE;
+        continue;
       }
       else if(s1 == "STARTOVER") {
-
-        cpu->fetch.has_insn = false;
-        cpu->decode1.has_insn = false;
-        cpu->decode2.has_insn = false;
-        cpu->int_exec.has_insn = false;
-        cpu->mult_exec.has_insn = false;
-        cpu->branch_exec.has_insn = false;
-        cpu->memory.has_insn = false;
-        cpu->mem_wb.has_insn = false;
-        cpu->int_wb.has_insn = false;
-        cpu->mult_wb.has_insn = false;
-        cpu->branch_wb.has_insn = false;
-        cpu->commitment.has_insn = false;
-        cpu->clock = 0;
-        cpu->pc = 4000;
-        cpu->fetch_from_next_cycle = TRUE;
-
+        //Back to the state right after loading the program -J
+        APEX_checkpoint_restore(cpu, *cpu->initial_state);
+        cpu->started_over = TRUE;
         return;
-        //cpu = APEX_cpu_init();
-      //  cpu->pc = 4000;
-      //  cpu->clock = 1;
-        //WE NEED TO FLUSH THE PIPELINE
       }
-
     }
-    else if (tok.size() == 2) {
-        std::string s1 = tok.at(0);
-
-      if (s1 == "RUN")
-        if (cpu->clock == stoi(tok.at(1))) {
-            exit(0);
-        }
-    }
-
-    else if (tok.size() == 3) {
-      std::string s1 = tok.at(0);
-      std::string s2 = tok.at(1);
-      std::string s3 = tok.at(2);
-
-      if (s1 == "SHOWMEM"){
-        int start_addr = stoi(s2);
-        int end_addr = stoi(s3);
-        print_mem(cpu, start_addr, end_addr );
-
-      }
-
 
+    //IF THE COMMAND DOESN'T MAP TO A VALID ACTION, IT WILL JUST IGNORE IT
+    if (cpu->num_actions < MAX_ACTIONS &&
+        parse_action(tok, &cpu->actions[cpu->num_actions]))
+    {
+      cpu->num_actions++;
     }
+  }
 
-
+  APEX_run_actions(cpu);
 }
@@ -10,53 +10,95 @@
 #define _APEX_CPU_H_
 
 #include "apex_macros.h"
+#include "apex_trace.h"
 #include <vector>
 #include <queue>
 #include <list>
 #include <climits>
+#include <stdint.h>
 #include <iostream>
 using namespace std;
 
-/* Format of an APEX instruction  */
+/* Format of an APEX instruction, pre-decoded once by create_code_memory() */
 typedef struct APEX_Instruction
 {
-    char opcode_str[128];
-    int opcode;
+    int16_t opcode;
+    int8_t vfu;       /* *_VFU the instruction issues to */
+    uint8_t flags;    /* INSN_* operand shape and branch class */
+    uint8_t latency;  /* Execute cycles */
     int rd;
     int rs1;
     int rs2;
     int imm;
 } APEX_Instruction;
 
-/* Model of CPU stage latch */
+//REORDER BUFFER, config.rob_size ENTRIES
+
+typedef struct ROB_Entry
+{
+    int pc_value;
+    int ar_addr;
+    int result;
+    int opcode;
+    int status_bit; //0 for invalid, 1 for valid -J
+    int itype;
+    int prev_phys_reg; //Mapping of ar_addr replaced at rename, released at commit (-1 if none)
+    int flags_reg; //Physical register that holds the flags it sets, -1 if it sets none
+    int prev_flags_reg; //Flags mapping replaced at rename, released at commit (-1 if none)
+}ROB_Entry;
+
+/*
+ * Model of CPU stage latch. Latches are copied on every stage advance, so
+ * keep this within a cache line: the mnemonic is looked up from the opcode
+ * when displayed, register tags fit in 16 bits (MAX_PHYS_REG_FILE_SIZE) and
+ * flags are bytes.
+ */
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
-    int opcode;
-    int rs1;
-    int rs2;
-    int rd;
     int imm;
     int rs1_value;
     int rs2_value;
     int result_buffer;
     int memory_address;
-    int inc_address_buffer; /*For LDI and STI instructions that need a way to carry the incremented src1 address over from EX stage -J*/
-    int has_insn;
-    int stage_delay; //Counter to delay MUL by four cycles -J
-    int vfu; //Just to lessen the amount of switch statements -J
-    int stall; //Make it easier to explicitly stall instructions waiting for ROB/IQ/LSQ -J
-    int btb_miss; // This flag will only be set when a BTB miss occurs -H
-    int btb_prediciton; // This will store the predicition to take / NOT take branch -H
+    int ras_entry; // cpu->ras[ras_top - 1] right after this control transfer, what a wrong path may overwrite
+    int rob_id; // ROB slot, assigned in decode2; completion indexes it directly
+    unsigned int seq; // Dispatch order, compared by difference so it may wrap
+    unsigned int pred_history; // Global (or for JUMP/JALR, path) history the prediction used
+    int fetch_cycle; // Clock when fetched, for the mispredict flush count
+    int pred_target; // JUMP/JALR/RET target fetch followed, -1 if none
+    int16_t opcode;
+    int16_t rs1;
+    int16_t rs2;
+    int16_t rd;
+    int8_t has_insn;
+    int8_t stage_delay; //Counter to delay MUL by four cycles -J
+    int8_t vfu; //Just to lessen the amount of switch statements -J
+    int8_t stall; //Make it easier to explicitly stall instructions waiting for ROB/IQ/LSQ -J
+    int8_t btb_miss; // This flag will only be set when a BTB miss occurs -H
+    int8_t btb_prediciton; // This will store the predicition to take / NOT take branch -H
+    int8_t pred_taken; // Direction predictor output, used by decode1 on a BTB miss
+    int8_t ras_top; // cpu->ras_top right after this control transfer, restored on a mispredict
 } CPU_Stage;
 
+static_assert(sizeof(CPU_Stage) <= 64, "CPU_Stage should fit in a cache line");
+
 typedef struct BTB_Entry
 {
     int valid; // If valid: BTB Hit, otherwise BTB Miss -H
+    int tag; // pc of the branch
     int outcome; // Based on previous branch outcome 0: Not Taken 1: Taken -H
+    int target; // pc fetched when predicted taken
+    unsigned int last_use; // cpu->btb_stamp at the last lookup hit or update, for LRU
 } BTB_Entry;
 
+/* Indirect target cache entry, see APEX_itc_lookup() */
+typedef struct ITC_Entry
+{
+    int tag; // pc of the JUMP/JALR, -1 when empty
+    int target; // Where it went last time with this path history
+} ITC_Entry;
+
 /*typedef struct BT_Entry
   int opcode;
   int branch_pc;
@@ -102,38 +144,139 @@ typedef struct IQ_Entry
   int pc_value; //For tiebreaking -J
   // We need the prediction in the exe stage for branches -H
   int btb_prediciton; // This will store the predicition to take / NOT take branch -H
+  unsigned int pred_history; //Carried to the branch unit to train the predictor
+  int fetch_cycle;
+  int pred_target;
 
   int iq_time_padding; //Make it wait a cycle before getting grabbed -J
+  int rob_id;
+  unsigned int seq; //Dispatch order, see CPU_Stage
 }IQ_Entry;
 
 
-//REORDER BUFFER WITH 16 ENTRIES
+/* Load/store queue entry, see lsq_push(); the LSQ is a ring in dispatch order */
+typedef struct LSQ_Entry
+{
+    int pc;
+    int opcode;       /* OPCODE_LOAD or OPCODE_STORE */
+    unsigned int seq; /* Dispatch order, see CPU_Stage */
+    int rob_id;
+    int dest;         /* LOAD destination physical register */
+    int address;      /* Valid once addr_known */
+    int data;         /* STORE value, valid once data_known */
+    int data_tag;     /* STORE source physical register while !data_known */
+    int addr_known;   /* An integer unit has computed the address */
+    int data_known;   /* STOREs may issue before their data is written back */
+    int issued;       /* LOAD sent to the memory stage or forwarded */
+} LSQ_Entry;
+
+/* Committed STORE on its way to data memory, see APEX_commitment() */
+typedef struct Store_Buffer_Entry
+{
+    int pc;
+    unsigned int seq;
+    int address;
+    int data;
+} Store_Buffer_Entry;
 
-typedef struct ROB_Entry
+/* Architectural to physical mapping, small enough to snapshot by assignment */
+typedef struct Rename_Map
 {
-    int pc_value;
-    int ar_addr;
-    int result;
-    int opcode;
-    int status_bit; //0 for invalid, 1 for valid -J
-    int itype;
-}ROB_Entry;
+    int16_t phys[REG_FILE_SIZE+1]; /* -1 until the register is first renamed, CC_INDEX maps the flags */
+} Rename_Map;
 
-typedef struct Rename_Entry
+/*
+ * State at a branch that may mispredict, restored when it does. The free
+ * list bitmap is kept beside it in cpu->branch_ckpt_free.
+ */
+typedef struct Branch_Checkpoint
 {
-    int id; //can del
-    int phys_reg_id;
-} Rename_Entry;
+    unsigned int seq;         /* Branch that took it */
+    int rob_tail;             /* First ROB slot after the branch */
+    Rename_Map map;
+    int free_count;
+    int ras_top;              /* Return stack right after the branch, */
+    int ras_entry;            /* and the entry under its top */
+} Branch_Checkpoint;
 
 typedef struct RF_Entry
 {
     int value;  //whatever supposed 2 be stored in the RF
-    int cc; //2 bit extension;
+    int cc; //2 bit extension; CC_ZERO | CC_POSITIVE of a flag writer's result
     int src_bit; //0 == invalid, 1 == valid -J
+    int maps; //Register and/or flags mappings to it no committed instruction has replaced yet
 
 } RF_Entry;
 
 
+/* Microarchitecture sizes, set from a config file or the command line */
+typedef struct APEX_Config
+{
+    int iq_size;            /* Issue queue entries */
+    int rob_size;           /* Reorder buffer entries */
+    int lsq_size;           /* Load/store queue entries */
+    int store_buffer_size;  /* Committed STOREs waiting to write memory */
+    int phys_reg_file_size; /* Physical registers */
+    int fetch_width;        /* Instructions fetched, decoded and renamed per cycle */
+    int mul_units;          /* Multipliers */
+    int mul_latency;        /* Cycles per MUL */
+    int mul_pipelined;      /* A multiplier starts a new MUL every cycle */
+    int int_units;          /* Integer ALUs, LOAD/STORE still share one memory stage */
+    int issue_width;        /* IQ entries issued per cycle, at most one per free unit */
+    int commit_width;       /* ROB entries retired per cycle */
+    int btb_sets;           /* BTB sets, a power of two */
+    int btb_ways;           /* BTB associativity */
+    int predictor;          /* PRED_* conditional branch direction predictor */
+    int pred_table_bits;    /* log2 of the predictor table entries */
+    int pred_history;       /* Global history bits */
+    int itc_size;           /* Indirect target cache entries, a power of two */
+    int itc_history;        /* Path history bits in the indirect target cache index */
+    int ras_size;           /* Return address stack entries */
+    int branch_checkpoints; /* Branches in flight with a rename checkpoint */
+} APEX_Config;
+
+/* Why commit stopped each cycle, see APEX_commitment() */
+typedef struct APEX_Commit_Stats
+{
+    long width_limited;   /* Retired commit_width and the next head was complete too */
+    long head_incomplete; /* Head entry still executing */
+    long rob_empty;
+    long retired[MAX_COMMIT_WIDTH + 1]; /* Cycles by number of entries retired */
+} APEX_Commit_Stats;
+
+/* Conditional branches resolved in the branch unit */
+typedef struct APEX_Branch_Stats
+{
+    long resolved;
+    long mispredicted;
+    long flush_cycles; /* Fetch to resolution of each mispredicted branch or RET */
+    long returns_predicted; /* RETs fetched down the return stack's target */
+    long returns_mispredicted;
+    long indirect_predicted; /* JUMP/JALR fetched down the target cache's target */
+    long indirect_mispredicted;
+    long squashed; /* Younger instructions dropped by mispredict recovery */
+} APEX_Branch_Stats;
+
+/* LOADs by where their data came from */
+typedef struct APEX_LSQ_Stats
+{
+    long loads;     /* Completed from memory or an older STORE */
+    long forwarded; /* Took the data of an older STORE still in the LSQ */
+    long bypassed;  /* Read memory while an older STORE to another address was in the LSQ */
+    long buffered;  /* Took the data of a committed STORE still in the store buffer */
+    long drained;   /* STOREs written from the store buffer to memory */
+    long buffer_full; /* Cycles commit waited on a full store buffer, or for it to drain at HALT */
+} APEX_LSQ_Stats;
+
+/* One parsed user command, see APEX_command() */
+typedef struct APEX_Action
+{
+    int type;  /* ACTION_* */
+    int cycle; /* Cycle to act on, ACTION_EVERY_CYCLE for every cycle */
+    int start; /* SHOWMEM address range */
+    int end;
+} APEX_Action;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
@@ -141,59 +284,103 @@ typedef struct APEX_CPU
     int clock;                     /* Clock cycles elapsed */
     int insn_completed;            /* Instructions retired */
     RF_Entry arch_regs[REG_FILE_SIZE];       /* Integer register file */
-    RF_Entry phys_regs[20];
+    RF_Entry *phys_regs;           /* config.phys_reg_file_size entries */
     int code_memory_size;          /* Number of instruction in the input file */
     APEX_Instruction *code_memory; /* Code Memory */
     int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
+    APEX_Config config;            /* Structure sizes for this instance */
     int single_step;               /* Wait for user input after every cycle */
+    int batch_mode;                /* No per-cycle output, summary only */
+    int cycle_limit;               /* Stop after this many cycles (0 = run to HALT) */
+    int insn_limit;                /* Stop once this many have retired (0 = no limit) */
+    int halted;                    /* HALT committed */
+    double host_seconds;           /* Host CPU time spent in APEX_cpu_run */
+    int stop_requested;            /* STOP or RUN limit reached */
+    int started_over;              /* STARTOVER during this cycle, don't advance the clock */
+    long ffwd_insns;               /* Executed by the functional interpreter */
+    APEX_Commit_Stats commit_stats;
+    APEX_Branch_Stats branch_stats;
+    APEX_LSQ_Stats lsq_stats;
+    APEX_Trace trace;              /* Per-stage trace ring */
     int set_cycle_max;
-    int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
+    int zero_flag;                 /* {TRUE, FALSE} As committed, branches read them while the flags were never renamed */
     int positive_flag;
     int fetch_from_next_cycle;
 
     /* Pipeline stages */
     CPU_Stage fetch;
-    CPU_Stage decode1;
-    CPU_Stage decode2;
-    CPU_Stage mult_exec;   //MULTIPLICATION UNIT
-    CPU_Stage int_exec;    //INTEGER UNIT
+    CPU_Stage decode1[MAX_FETCH_WIDTH]; /* Slot 0 is the oldest of the group */
+    CPU_Stage decode2[MAX_FETCH_WIDTH];
+    CPU_Stage mult_exec[MAX_FU_UNITS * MAX_MUL_LATENCY]; //MULTIPLICATION UNITS, one slot per stage when pipelined
+    CPU_Stage int_exec[MAX_FU_UNITS];    //INTEGER UNITS
     CPU_Stage branch_exec; //BRANCH UNIT EXECUTION
     CPU_Stage memory;
     CPU_Stage commitment; //Need a stage to settle accounts w/ IQ, LSQ, and ROB -J
 
-    CPU_Stage mult_wb;
-    CPU_Stage int_wb;
+    CPU_Stage mult_wb[MAX_FU_UNITS]; //One writeback port per unit
+    CPU_Stage int_wb[MAX_FU_UNITS];
     CPU_Stage branch_wb;
     CPU_Stage mem_wb; //LOAD, LDI, and STI share a single cycle WB stage -J
 
-    /* Assume the following -H
-        - btb[0] - BN
-        - btb[1] - BNZ
-        - btb[2] - BP
-        - btb[3] - BNP
-    */
-    BTB_Entry btb[4]; // There are 4 types of branch instructions -H
-    int branch_flag; // Set flag if there is a branch instruction already executing in the pipeline. -H
-
-    Rename_Entry rename_table[REG_FILE_SIZE+1];  /*last element in CC is the
+    BTB_Entry *btb; // config.btb_sets sets of config.btb_ways, see apex_btb.cpp
+    unsigned int btb_stamp; // LRU clock of the BTB
+    int16_t *pred_table; // APEX_predictor_entries() counters/weights, see apex_predictor.cpp
+    unsigned int branch_history; // Resolved outcomes, newest in bit 0
+    int ras[MAX_RAS_SIZE]; // Return address stack, circular over config.ras_size, -1 = never pushed
+    int ras_top; // Slot the next JALR pushes to
+    ITC_Entry *itc; // config.itc_size entries
+    unsigned int path_history; // Targets of resolved JUMP/JALRs, two bits each
+    unsigned int dispatch_seq; // seq of the last dispatched instruction
+
+    Rename_Map rename_table;  /*last element in CC is the
                                         most recently allocated phys. reg*/
 
   //earlier dispatch instruction = tie breaker
-    IQ_Entry iq[8]; //8 entries
+    IQ_Entry *iq; //config.iq_size entries
+
+    /* Select state, one bit per IQ slot (so at most MAX_IQ_SIZE entries) */
+    uint64_t iq_slots;              /* Slots that exist in this config */
+    uint64_t iq_valid;              /* Occupied slots */
+    uint64_t iq_ready;              /* Occupied and all operands captured */
+    uint64_t iq_fu_mask[NUM_VFU];   /* Occupied slots per VFU */
+    uint64_t iq_older[MAX_IQ_SIZE]; /* Age matrix: row i = slots older than i */
                     //We don't need a vector bc PC value will be stored with each entry and we just flip status bit when used -J
                         //Can check business of FUs by has_insn
 
-    queue<int>* free_list; //nums 0-19 for the # reg
+    uint64_t* free_list; //Bitmap over the physical registers, bit set = free
+    int free_words;
+    int free_count;
+
+    Branch_Checkpoint* branch_ckpt; /* config.branch_checkpoints entries */
+    uint64_t* branch_ckpt_free;     /* Their free lists, free_words each */
+    uint64_t branch_ckpt_live;      /* Entries held by an unresolved branch */
+
+    vector<int>* wakeup; /* Per physical register: IQ slots waiting on it and
+                            WAKEUP_LSQ(lsq_id) STOREs waiting for it as data,
+                            so a writeback only visits its consumers */
+
+    ROB_Entry* rob; /*circular buffer of config.rob_size entries,
+                      preallocated so dispatch never allocates */
+    int rob_head;   /* Oldest entry, next to commit */
+    int rob_tail;   /* Slot the next dispatched instruction gets */
+    int rob_count;
+
+    LSQ_Entry* lsq; /* Circular buffer of config.lsq_size entries in dispatch
+                       order, indexed by the IQ entry's lsq_id */
+    int lsq_head;   /* Oldest memory instruction, leaves when it commits */
+    int lsq_tail;
+    int lsq_count;
 
-    list<ROB_Entry>* rob; /*check the size whenever
-                            we need to add to this queue
-                            maximum size 16 entries */
+    Store_Buffer_Entry* store_buffer; /* Ring of config.store_buffer_size entries,
+                                         oldest first; the head drains next */
+    int sb_head;
+    int sb_tail;
+    int sb_count;
 
-    queue<IQ_Entry>* lsq; /*LSQ entry has the same
-                          structure as an IQ entry.
-                          use queue because in order*/
+    APEX_Action actions[MAX_ACTIONS]; /* Parsed user command, run every cycle */
+    int num_actions;
 
-    std::string command;
+    vector<uint8_t>* initial_state; /* Checkpoint taken at load, for STARTOVER */
 
 } APEX_CPU;
 
@@ -204,8 +391,44 @@ typedef struct APEX_CPU
 
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
-APEX_CPU *APEX_cpu_init(const char *filename);
+const char *APEX_opcode_name(int opcode);
+void APEX_config_default(APEX_Config *config);
+int APEX_config_set(APEX_Config *config, const char *key, const char *value);
+int APEX_config_load(APEX_Config *config, const char *filename);
+int APEX_config_validate(const APEX_Config *config);
+void APEX_config_print(const APEX_Config *config, FILE *out);
+void APEX_config_csv_header(FILE *out);
+void APEX_config_csv_row(const APEX_Config *config, FILE *out);
+APEX_CPU *APEX_cpu_init(const char *filename, const APEX_Config *config, int batch_mode);
 void APEX_cpu_run(APEX_CPU *cpu);
+long APEX_functional_run(APEX_CPU *cpu, long max_insns, int stop_pc, int warm_btb);
+int APEX_cpu_switch_over(APEX_CPU *cpu);
+BTB_Entry *APEX_btb_lookup(APEX_CPU *cpu, int pc);
+void APEX_btb_update(APEX_CPU *cpu, int pc, int taken, int target);
+int APEX_btb_entries(const APEX_Config *config);
+int APEX_predictor_entries(const APEX_Config *config);
+void APEX_predictor_reset(APEX_CPU *cpu);
+int APEX_predictor_predict(const APEX_CPU *cpu, int pc, const BTB_Entry *entry);
+void APEX_predictor_update(APEX_CPU *cpu, int pc, unsigned int history, int taken);
+const char *APEX_predictor_name(int predictor);
+int APEX_itc_lookup(const APEX_CPU *cpu, int pc, unsigned int history);
+void APEX_itc_update(APEX_CPU *cpu, int pc, unsigned int history, int target);
+void APEX_ras_push(APEX_CPU *cpu, int return_pc);
+int APEX_ras_pop(APEX_CPU *cpu);
+int APEX_functional_handoff(APEX_CPU *detail, const APEX_CPU *func);
+void APEX_checkpoint_save(const APEX_CPU *cpu, std::vector<uint8_t> &buf);
+int APEX_checkpoint_restore(APEX_CPU *cpu, const std::vector<uint8_t> &buf);
+int APEX_checkpoint_write(const APEX_CPU *cpu, const char *filename);
+int APEX_checkpoint_read(APEX_CPU *cpu, const char *filename);
+void APEX_cpu_print_summary(const APEX_CPU *cpu);
+void APEX_cpu_set_trace(APEX_CPU *cpu, unsigned int mask, int level, size_t buffer_size, FILE *sink);
 void APEX_cpu_stop(APEX_CPU *cpu);
 void APEX_command(APEX_CPU *cpu, std::string input);
+int APEX_sample(const char *filename, const APEX_Config *config, long period,
+                int warmup, int window, FILE *out);
+int APEX_simpoint(const char *filename, const APEX_Config *config, long interval,
+                  int max_k, const char *checkpoint_prefix, FILE *out);
+int APEX_sweep(const char *grid_file, const APEX_Config *base,
+               const std::vector<std::string> &programs, int threads,
+               int cycle_limit, FILE *out);
 #endif
@@ -0,0 +1,246 @@
+/*
+ * apex_functional.cpp
+ * Contains the functional (architectural) APEX interpreter used to fast
+ * forward to a region of interest. APEX_cpu_switch_over() then hands its
+ * state to the out-of-order pipeline, or APEX_functional_handoff() to a
+ * separate detailed CPU.
+ *
+ * The interpreter works directly on cpu->arch_regs, cpu->data_memory,
+ * cpu->pc and the condition flags, one instruction at a time with no
+ * pipeline, rename or queues.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Same flag rules as the execute stage */
+static void
+set_flags(APEX_CPU *cpu, int result)
+{
+    cpu->zero_flag = (result == 0) ? TRUE : FALSE;
+    cpu->positive_flag = (result > 0) ? TRUE : FALSE;
+}
+
+static int
+valid_data_address(int address)
+{
+    return address >= 0 && address < DATA_MEMORY_SIZE;
+}
+
+/*
+ * Executes instructions from cpu->pc until max_insns have retired, the next
+ * instruction is at stop_pc (ignored if negative) or HALT is reached. With
+ * warm_btb set, conditional branches train the BTB and direction predictor
+ * the way branch execute does, JUMP/JALR the indirect target cache, and
+ * JALR/RET keep the return stack. Returns the number of instructions
+ * executed (also added to cpu->ffwd_insns), or -1 if the program left code
+ * or data memory.
+ */
+long
+APEX_functional_run(APEX_CPU *cpu, long max_insns, int stop_pc, int warm_btb)
+{
+    RF_Entry *regs = cpu->arch_regs;
+    long executed = 0;
+
+    while (executed < max_insns)
+    {
+        int index = (cpu->pc - 4000) / 4;
+        const APEX_Instruction *ins;
+        int next_pc = cpu->pc + 4;
+        int taken = FALSE;
+        int address;
+
+        if (cpu->pc == stop_pc && executed > 0)
+        {
+            break;
+        }
+        if (index < 0 || index >= cpu->code_memory_size)
+        {
+            fprintf(stderr, "APEX_Error: fast forward left code memory at pc %d\n", cpu->pc);
+            return -1;
+        }
+
+        ins = &cpu->code_memory[index];
+        switch (ins->opcode)
+        {
+            case OPCODE_ADD:
+                regs[ins->rd].value = regs[ins->rs1].value + regs[ins->rs2].value;
+                set_flags(cpu, regs[ins->rd].value);
+                break;
+
+            case OPCODE_ADDL:
+                regs[ins->rd].value = regs[ins->rs1].value + ins->imm;
+                set_flags(cpu, regs[ins->rd].value);
+                break;
+
+            case OPCODE_SUB:
+                regs[ins->rd].value = regs[ins->rs1].value - regs[ins->rs2].value;
+                set_flags(cpu, regs[ins->rd].value);
+                break;
+
+            case OPCODE_SUBL:
+                regs[ins->rd].value = regs[ins->rs1].value - ins->imm;
+                set_flags(cpu, regs[ins->rd].value);
+                break;
+
+            case OPCODE_MUL:
+                regs[ins->rd].value = regs[ins->rs1].value * regs[ins->rs2].value;
+                set_flags(cpu, regs[ins->rd].value);
+                break;
+
+            case OPCODE_AND:
+                regs[ins->rd].value = regs[ins->rs1].value & regs[ins->rs2].value;
+                set_flags(cpu, regs[ins->rd].value);
+                break;
+
+            case OPCODE_OR:
+                regs[ins->rd].value = regs[ins->rs1].value | regs[ins->rs2].value;
+                set_flags(cpu, regs[ins->rd].value);
+                break;
+
+            case OPCODE_EXOR:
+                regs[ins->rd].value = regs[ins->rs1].value ^ regs[ins->rs2].value;
+                set_flags(cpu, regs[ins->rd].value);
+                break;
+
+            case OPCODE_MOVC:
+                regs[ins->rd].value = ins->imm;
+                set_flags(cpu, regs[ins->rd].value);
+                break;
+
+            case OPCODE_CMP:
+                cpu->zero_flag = (regs[ins->rs1].value == regs[ins->rs2].value) ? TRUE : FALSE;
+                cpu->positive_flag = (regs[ins->rs1].value > regs[ins->rs2].value) ? TRUE : FALSE;
+                break;
+
+            case OPCODE_LOAD:
+                address = regs[ins->rs1].value + ins->imm;
+                if (!valid_data_address(address))
+                {
+                    fprintf(stderr, "APEX_Error: fast forward LOAD from %d at pc %d\n",
+                            address, cpu->pc);
+                    return -1;
+                }
+                regs[ins->rd].value = cpu->data_memory[address];
+                break;
+
+            case OPCODE_STORE:
+                address = regs[ins->rs2].value + ins->imm;
+                if (!valid_data_address(address))
+                {
+                    fprintf(stderr, "APEX_Error: fast forward STORE to %d at pc %d\n",
+                            address, cpu->pc);
+                    return -1;
+                }
+                cpu->data_memory[address] = regs[ins->rs1].value;
+                break;
+
+            case OPCODE_BZ:
+                taken = cpu->zero_flag;
+                break;
+
+            case OPCODE_BNZ:
+                taken = !cpu->zero_flag;
+                break;
+
+            case OPCODE_BP:
+                taken = cpu->positive_flag;
+                break;
+
+            case OPCODE_BNP:
+                taken = !cpu->positive_flag;
+                break;
+
+            case OPCODE_JUMP:
+                next_pc = regs[ins->rs1].value + ins->imm;
+                if (warm_btb)
+                {
+                    APEX_itc_update(cpu, cpu->pc, cpu->path_history, next_pc);
+                }
+                break;
+
+            case OPCODE_JALR:
+                next_pc = regs[ins->rs1].value + ins->imm;
+                regs[ins->rd].value = cpu->pc + 4;
+                if (warm_btb)
+                {
+                    APEX_itc_update(cpu, cpu->pc, cpu->path_history, next_pc);
+                    APEX_ras_push(cpu, cpu->pc + 4);
+                }
+                break;
+
+            case OPCODE_RET:
+                next_pc = regs[ins->rs1].value;
+                if (warm_btb)
+                {
+                    APEX_ras_pop(cpu);
+                }
+                break;
+
+            case OPCODE_HALT:
+                cpu->halted = TRUE;
+                executed++;
+                cpu->ffwd_insns += executed;
+                return executed;
+        }
+
+        if (ins->flags & INSN_COND_BRANCH)
+        {
+            if (taken)
+            {
+                next_pc = cpu->pc + ins->imm;
+            }
+            if (warm_btb)
+            {
+                APEX_btb_update(cpu, cpu->pc, taken, cpu->pc + ins->imm);
+                APEX_predictor_update(cpu, cpu->pc, cpu->branch_history, taken);
+            }
+        }
+        if (ins->flags & INSN_HAS_RD)
+        {
+            regs[ins->rd].src_bit = 1;
+        }
+
+        cpu->pc = next_pc;
+        executed++;
+    }
+
+    cpu->ffwd_insns += executed;
+    return executed;
+}
+
+/*
+ * Starts a detailed CPU from the point a functional CPU of the same program
+ * has reached: the detailed CPU is reset to its load state, given the
+ * architectural registers, memory, flags and branch prediction state, and
+ * switched over.
+ */
+int
+APEX_functional_handoff(APEX_CPU *detail, const APEX_CPU *func)
+{
+    if (APEX_checkpoint_restore(detail, *detail->initial_state) != 0)
+    {
+        return -1;
+    }
+
+    memcpy(detail->arch_regs, func->arch_regs, sizeof(func->arch_regs));
+    memcpy(detail->data_memory, func->data_memory, sizeof(func->data_memory));
+    memcpy(detail->btb, func->btb, APEX_btb_entries(&func->config) * sizeof(BTB_Entry));
+    detail->btb_stamp = func->btb_stamp;
+    memcpy(detail->pred_table, func->pred_table,
+           APEX_predictor_entries(&func->config) * sizeof(int16_t));
+    detail->branch_history = func->branch_history;
+    memcpy(detail->ras, func->ras, sizeof(func->ras));
+    detail->ras_top = func->ras_top;
+    memcpy(detail->itc, func->itc, func->config.itc_size * sizeof(ITC_Entry));
+    detail->path_history = func->path_history;
+    detail->pc = func->pc;
+    detail->zero_flag = func->zero_flag;
+    detail->positive_flag = func->positive_flag;
+    detail->halted = FALSE;
+
+    return APEX_cpu_switch_over(detail);
+}
@@ -17,7 +17,60 @@
 
 /* Size of integer register file */
 #define REG_FILE_SIZE 16
+
+/* Default microarchitecture sizes, see APEX_Config */
 #define PHYS_REG_FILE_SIZE 20
+#define MAX_PHYS_REG_FILE_SIZE 4096 /* Rename map entries are 16 bits */
+#define IQ_SIZE 8
+#define ROB_SIZE 16
+#define LSQ_SIZE 6
+#define STORE_BUFFER_SIZE 4
+#define FETCH_WIDTH 1
+#define MAX_FETCH_WIDTH 8
+#define MUL_UNITS 1
+#define MUL_LATENCY 3
+#define INT_UNITS 1
+#define ISSUE_WIDTH 1
+#define COMMIT_WIDTH 1
+#define MAX_FU_UNITS 8     /* Per functional unit class */
+#define MAX_MUL_LATENCY 16
+#define MAX_ISSUE_WIDTH (2 * MAX_FU_UNITS + 1) /* Every MUL, INT and the branch unit */
+#define MAX_COMMIT_WIDTH 8
+#define BTB_SETS 16
+#define BTB_WAYS 2
+#define MAX_BTB_SETS 4096
+#define MAX_BTB_WAYS 16
+#define PREDICTOR PRED_LAST
+#define PRED_TABLE_BITS 10     /* log2 of the predictor table entries */
+#define MAX_PRED_TABLE_BITS 16
+#define PRED_HISTORY 12        /* Global history bits */
+#define MAX_PRED_HISTORY 32    /* Held in an unsigned int */
+#define ITC_SIZE 16            /* Indirect target cache entries, a power of two */
+#define MAX_ITC_SIZE 4096
+#define ITC_HISTORY 4          /* Path history bits mixed into its index */
+#define RAS_SIZE 8
+#define MAX_RAS_SIZE 64        /* Top index travels in an int8_t */
+#define BRANCH_CHECKPOINTS 8   /* Unresolved branches with rename checkpoints */
+#define MAX_BRANCH_CHECKPOINTS 64 /* Live ones are a 64-bit mask */
+
+/* Conditional branch direction predictors, see apex_predictor.cpp */
+#define PRED_LAST 0       /* Last outcome kept in the BTB entry */
+#define PRED_BIMODAL 1
+#define PRED_GSHARE 2
+#define PRED_TAGE 3
+#define PRED_PERCEPTRON 4
+#define NUM_PREDICTORS 5
+
+/* Issue select keeps one bit per IQ slot in a 64-bit mask */
+#define MAX_IQ_SIZE 64
+#define IQ_BIT(i) ((uint64_t)1 << (i))
+
+/* No IQ entry selected */
+#define IQ_NONE -1
+
+/* A STORE waiting in the LSQ for its data sits on the data tag's wakeup list
+ * as a negative entry; the mapping is its own inverse */
+#define WAKEUP_LSQ(id) (-1 - (id))
 /* Numeric OPCODE identifiers for instructions */
 #define OPCODE_ADD 0x0
 #define OPCODE_SUB 0x1
@@ -44,6 +97,17 @@
 /*other expanded instructions*/
 #define OPCODE_JALR 0x14
 #define OPCODE_RET 0x15
+#define NUM_OPCODES 0x16
+
+/* Pre-decoded operand shape and branch class, see APEX_Instruction */
+#define INSN_HAS_RD 0x01
+#define INSN_HAS_RS1 0x02
+#define INSN_HAS_RS2 0x04
+#define INSN_HAS_IMM 0x08
+#define INSN_MEM 0x10
+#define INSN_COND_BRANCH 0x20 /* BZ, BNZ, BP, BNP: predicted through the BTB */
+#define INSN_INDIRECT 0x40    /* JUMP, JALR, RET: target comes from a register */
+#define INSN_SETS_FLAGS 0x80  /* Writes the zero/positive flags when it executes */
 
 /* Set this flag to 1 to enable debug messages */
 #define ENABLE_DEBUG_MESSAGES 1
@@ -56,8 +120,11 @@
 #define MUL_VFU 0
 #define INT_VFU 1
 #define BRANCH_VFU 2
+#define NUM_VFU 3
 
-#define CC_INDEX 16
+#define CC_INDEX 16 /* Rename map entry of the zero/positive flags */
+#define CC_ZERO 0x1
+#define CC_POSITIVE 0x2
 
 /*Clear cut macros of any field that represents src or status bit in IQ or ROB entries -C*/
 #define VALID 1
@@ -67,6 +134,18 @@
 #define NOT_READY 0
 #define READY 1
 
+/* Command actions, parsed once by APEX_command() */
+#define MAX_ACTIONS 16
+#define ACTION_EVERY_CYCLE -1
+#define ACTION_RUN_UNTIL 0
+#define ACTION_SHOW_REGS 1
+#define ACTION_SHOW_RNT 2
+#define ACTION_SHOW_IQ 3
+#define ACTION_SHOW_ROB 4
+#define ACTION_SHOW_BTB 5
+#define ACTION_SHOW_LSQ 6
+#define ACTION_SHOW_MEM 7
+
 /* ITYPES */
 #define MEMORY_ITYPE 0
 #define ARITHMETIC_ITYPE 1
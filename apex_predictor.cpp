@@ -0,0 +1,395 @@
+/*
+ * apex_predictor.cpp
+ * Contains the conditional branch direction predictors, selected with
+ * config.predictor:
+ *
+ *   last        the outcome stored in the branch's BTB entry (the original
+ *               scheme, no table of its own)
+ *   bimodal     2-bit counters indexed by pc
+ *   gshare      2-bit counters indexed by pc xor global history
+ *   tage        a bimodal base plus TAGE_TABLES tagged tables using
+ *               geometrically longer slices of the history; the longest
+ *               matching table provides the prediction
+ *   perceptron  one weight per history bit plus a bias, per pc
+ *
+ * The BTB still supplies the taken target and decides whether fetch can
+ * redirect; a miss falls back to this direction in decode1. All state is
+ * in cpu->pred_table (int16_t, layout per predictor below) and the global
+ * history cpu->branch_history. The history is shifted only when a branch
+ * resolves, so it is never wrong-path, and every branch carries the
+ * history it was predicted with so training indexes the same entries.
+ *
+ * The indirect target cache for JUMP/JALR and the return address stack
+ * for RET are at the end of the file.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#define TAGE_TABLES 4
+#define TAGE_TAG_BITS 8
+#define TAGE_ENTRY 3 /* int16_t per tagged entry: tag + 1 (0 = empty), counter, useful */
+
+#define PERCEPTRON_WEIGHT_MAX 127
+
+static const char *const predictor_names[NUM_PREDICTORS] = {
+    "last", "bimodal", "gshare", "tage", "perceptron",
+};
+
+const char *
+APEX_predictor_name(int predictor)
+{
+    if (predictor < 0 || predictor >= NUM_PREDICTORS)
+    {
+        return NULL;
+    }
+    return predictor_names[predictor];
+}
+
+static int
+table_size(const APEX_Config *config)
+{
+    return 1 << config->pred_table_bits;
+}
+
+/* Entries per tagged TAGE table, a quarter of the base table */
+static int
+tage_size(const APEX_Config *config)
+{
+    return config->pred_table_bits >= 2 ? table_size(config) >> 2 : 1;
+}
+
+int
+APEX_predictor_entries(const APEX_Config *config)
+{
+    switch (config->predictor)
+    {
+        case PRED_BIMODAL:
+        case PRED_GSHARE:
+            return table_size(config);
+
+        case PRED_TAGE:
+            return table_size(config) + TAGE_TABLES * tage_size(config) * TAGE_ENTRY;
+
+        case PRED_PERCEPTRON:
+            return table_size(config) * (config->pred_history + 1);
+    }
+    return 0;
+}
+
+/* Weakly taken counters, empty tagged tables and zero weights */
+void
+APEX_predictor_reset(APEX_CPU *cpu)
+{
+    int entries = APEX_predictor_entries(&cpu->config);
+
+    for (int i = 0; i < entries; ++i)
+    {
+        cpu->pred_table[i] = 0;
+    }
+    if (cpu->config.predictor != PRED_PERCEPTRON)
+    {
+        int counters = entries ? table_size(&cpu->config) : 0;
+
+        for (int i = 0; i < counters; ++i)
+        {
+            cpu->pred_table[i] = 2;
+        }
+    }
+    cpu->branch_history = 0;
+}
+
+/* The newest `length` history bits xor-folded down to `bits` bits */
+static unsigned int
+fold_history(unsigned int history, int length, int bits)
+{
+    unsigned int folded = 0;
+
+    if (length < 32)
+    {
+        history &= (1u << length) - 1;
+    }
+    for (; history; history >>= bits)
+    {
+        folded ^= history & ((1u << bits) - 1);
+    }
+    return folded;
+}
+
+static void
+train_counter(int16_t *counter, int taken, int min, int max)
+{
+    if (taken && *counter < max)
+    {
+        ++*counter;
+    }
+    else if (!taken && *counter > min)
+    {
+        --*counter;
+    }
+}
+
+static int
+counter_index(const APEX_CPU *cpu, int pc, unsigned int history)
+{
+    unsigned int index = pc / 4;
+
+    if (cpu->config.predictor == PRED_GSHARE)
+    {
+        index ^= fold_history(history, cpu->config.pred_history, cpu->config.pred_table_bits);
+    }
+    return index & (table_size(&cpu->config) - 1);
+}
+
+/* Tagged entries a TAGE lookup found, by table; provider/alt are -1 for the base table */
+typedef struct Tage_Lookup
+{
+    int16_t *entry[TAGE_TABLES]; /* Indexed slot of each table */
+    int16_t tag[TAGE_TABLES];    /* Tag this branch has there, + 1 */
+    int provider;
+    int alt;
+    int16_t *base;
+} Tage_Lookup;
+
+/* Table t sees the newest pred_history >> (TAGE_TABLES - 1 - t) bits, at least one */
+static int
+tage_history_length(const APEX_Config *config, int t)
+{
+    int length = config->pred_history >> (TAGE_TABLES - 1 - t);
+
+    return length > 0 ? length : 1;
+}
+
+static void
+tage_lookup(const APEX_CPU *cpu, int pc, unsigned int history, Tage_Lookup *l)
+{
+    const APEX_Config *config = &cpu->config;
+    int size = tage_size(config);
+    int index_bits = config->pred_table_bits >= 2 ? config->pred_table_bits - 2 : 0;
+    int16_t *tables = cpu->pred_table + table_size(config);
+
+    l->base = &cpu->pred_table[(pc / 4) & (table_size(config) - 1)];
+    l->provider = -1;
+    l->alt = -1;
+    for (int t = 0; t < TAGE_TABLES; ++t)
+    {
+        int length = tage_history_length(config, t);
+        unsigned int index = (pc / 4) ^ (index_bits ? fold_history(history, length, index_bits) : 0);
+        unsigned int tag = ((pc / 4) ^ (fold_history(history, length, TAGE_TAG_BITS - 1) << 1)) &
+                           ((1u << TAGE_TAG_BITS) - 1);
+
+        l->entry[t] = &tables[(t * size + (index & (size - 1))) * TAGE_ENTRY];
+        l->tag[t] = tag + 1;
+        if (l->entry[t][0] == l->tag[t])
+        {
+            l->alt = l->provider;
+            l->provider = t;
+        }
+    }
+}
+
+static int
+tage_direction(const Tage_Lookup *l, int table)
+{
+    return table < 0 ? *l->base >= 2 : l->entry[table][1] >= 0;
+}
+
+static int
+perceptron_output(const APEX_CPU *cpu, int pc, unsigned int history, int16_t **weights)
+{
+    int length = cpu->config.pred_history;
+    int y;
+
+    *weights = &cpu->pred_table[((pc / 4) & (table_size(&cpu->config) - 1)) * (length + 1)];
+    y = (*weights)[0];
+    for (int i = 0; i < length; ++i)
+    {
+        y += ((history >> i) & 1) ? (*weights)[i + 1] : -(*weights)[i + 1];
+    }
+    return y;
+}
+
+/*
+ * Predicted direction (TRUE = taken) of the conditional branch at pc with
+ * the current history. entry is its BTB entry, NULL on a miss, which the
+ * last-outcome predictor predicts taken.
+ */
+int
+APEX_predictor_predict(const APEX_CPU *cpu, int pc, const BTB_Entry *entry)
+{
+    unsigned int history = cpu->branch_history;
+
+    switch (cpu->config.predictor)
+    {
+        case PRED_BIMODAL:
+        case PRED_GSHARE:
+            return cpu->pred_table[counter_index(cpu, pc, history)] >= 2;
+
+        case PRED_TAGE:
+        {
+            Tage_Lookup l;
+
+            tage_lookup(cpu, pc, history, &l);
+            return tage_direction(&l, l.provider);
+        }
+
+        case PRED_PERCEPTRON:
+        {
+            int16_t *weights;
+
+            return perceptron_output(cpu, pc, history, &weights) >= 0;
+        }
+    }
+    return entry ? entry->outcome : TRUE;
+}
+
+/*
+ * Trains on a resolved branch that was predicted with `history`, then
+ * shifts its outcome into the global history.
+ */
+void
+APEX_predictor_update(APEX_CPU *cpu, int pc, unsigned int history, int taken)
+{
+    switch (cpu->config.predictor)
+    {
+        case PRED_BIMODAL:
+        case PRED_GSHARE:
+            train_counter(&cpu->pred_table[counter_index(cpu, pc, history)], taken, 0, 3);
+            break;
+
+        case PRED_TAGE:
+        {
+            Tage_Lookup l;
+            int predicted, alt_predicted;
+
+            tage_lookup(cpu, pc, history, &l);
+            predicted = tage_direction(&l, l.provider);
+            alt_predicted = tage_direction(&l, l.alt);
+
+            if (l.provider < 0)
+            {
+                train_counter(l.base, taken, 0, 3);
+            }
+            else
+            {
+                int16_t *provider = l.entry[l.provider];
+
+                train_counter(&provider[1], taken, -4, 3);
+                if (predicted != alt_predicted)
+                {
+                    train_counter(&provider[2], predicted == taken, 0, 3);
+                }
+            }
+
+            /* Mispredicted: claim one longer table, or age them so one frees up */
+            if (predicted != taken && l.provider < TAGE_TABLES - 1)
+            {
+                int t;
+
+                for (t = l.provider + 1; t < TAGE_TABLES && l.entry[t][2] != 0; ++t)
+                    ;
+                if (t < TAGE_TABLES)
+                {
+                    l.entry[t][0] = l.tag[t];
+                    l.entry[t][1] = taken ? 0 : -1;
+                    l.entry[t][2] = 0;
+                }
+                else
+                {
+                    for (t = l.provider + 1; t < TAGE_TABLES; ++t)
+                    {
+                        l.entry[t][2]--;
+                    }
+                }
+            }
+            break;
+        }
+
+        case PRED_PERCEPTRON:
+        {
+            int length = cpu->config.pred_history;
+            int threshold = (int)(1.93 * length + 14);
+            int16_t *weights;
+            int y = perceptron_output(cpu, pc, history, &weights);
+
+            if ((y >= 0) != taken || abs(y) <= threshold)
+            {
+                train_counter(&weights[0], taken, -PERCEPTRON_WEIGHT_MAX - 1, PERCEPTRON_WEIGHT_MAX);
+                for (int i = 0; i < length; ++i)
+                {
+                    train_counter(&weights[i + 1], taken == (int)((history >> i) & 1),
+                                  -PERCEPTRON_WEIGHT_MAX - 1, PERCEPTRON_WEIGHT_MAX);
+                }
+            }
+            break;
+        }
+    }
+
+    cpu->branch_history = (cpu->branch_history << 1) | (taken ? 1 : 0);
+}
+
+/*
+ * Indirect target cache: direct mapped, indexed by the JUMP/JALR pc xor
+ * the newest config.itc_history bits of path history and tagged with the
+ * pc. The path history shifts in two bits of every resolved JUMP/JALR
+ * target, so a jump whose target follows the path taken to it gets one
+ * entry per path. Like the direction history it only holds resolved
+ * transfers.
+ */
+static ITC_Entry *
+itc_entry(const APEX_CPU *cpu, int pc, unsigned int history)
+{
+    int size = cpu->config.itc_size;
+    int bits = __builtin_ctz(size);
+    unsigned int index = pc / 4;
+
+    if (bits)
+    {
+        index ^= fold_history(history, cpu->config.itc_history, bits);
+    }
+    return &cpu->itc[index & (size - 1)];
+}
+
+/* Predicted target of the JUMP/JALR at pc, -1 on a miss */
+int
+APEX_itc_lookup(const APEX_CPU *cpu, int pc, unsigned int history)
+{
+    const ITC_Entry *entry = itc_entry(cpu, pc, history);
+
+    return entry->tag == pc ? entry->target : -1;
+}
+
+/* Records where a JUMP/JALR predicted with `history` went, then extends the path */
+void
+APEX_itc_update(APEX_CPU *cpu, int pc, unsigned int history, int target)
+{
+    ITC_Entry *entry = itc_entry(cpu, pc, history);
+
+    entry->tag = pc;
+    entry->target = target;
+    cpu->path_history = (cpu->path_history << 2) | ((target / 4) & 3);
+}
+
+/*
+ * Return address stack: fetch pushes pc + 4 for every JALR and pops a
+ * predicted target for every RET. It is circular, so calls nested deeper
+ * than config.ras_size overwrite the oldest entries. Mispredicted branches
+ * and RETs restore only the top index they were fetched with, so an entry
+ * a wrong-path JALR overwrote stays wrong; the branch unit catches that.
+ */
+void
+APEX_ras_push(APEX_CPU *cpu, int return_pc)
+{
+    cpu->ras[cpu->ras_top] = return_pc;
+    cpu->ras_top = (cpu->ras_top + 1) % cpu->config.ras_size;
+}
+
+/* Predicted RET target, -1 if the slot was never pushed */
+int
+APEX_ras_pop(APEX_CPU *cpu)
+{
+    cpu->ras_top = (cpu->ras_top + cpu->config.ras_size - 1) % cpu->config.ras_size;
+    return cpu->ras[cpu->ras_top];
+}
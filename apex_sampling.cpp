@@ -0,0 +1,195 @@
+/*
+ * apex_sampling.cpp
+ * Contains SMARTS-style interval sampling: the program runs on the
+ * functional interpreter, and every `period` instructions a short window is
+ * simulated in detail to measure CPI. The per-window CPIs give an estimate of
+ * the whole program's cycle count with a confidence interval.
+ *
+ * The functional run keeps the predictor state warm: BTB, direction
+ * predictor, return stack and indirect target cache. Each window starts
+ * from a fresh detailed CPU loaded with the functional architectural and
+ * predictor state, runs `warmup` instructions to fill the
+ * pipeline and queues, then measures the next `window` instructions.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Give up on a window that retires slower than this (pipeline deadlock) */
+#define SAMPLE_MAX_CPI 64
+
+/* Two-sided 95% Student t quantiles for 1..30 degrees of freedom */
+static const double t_975[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static double
+t_quantile(int dof)
+{
+    if (dof < 1)
+    {
+        return 0.0;
+    }
+    if (dof <= (int)(sizeof(t_975) / sizeof(t_975[0])))
+    {
+        return t_975[dof - 1];
+    }
+    return 1.960;
+}
+
+/*
+ * Runs the detailed CPU until `insns` more instructions retire. Returns the
+ * cycles taken, or -1 if the program halted or the window stalled.
+ */
+static long
+run_detail(APEX_CPU *detail, int insns)
+{
+    int start_clock = detail->clock;
+
+    if (insns == 0)
+    {
+        return 0;
+    }
+    detail->insn_limit = detail->insn_completed + insns;
+    detail->cycle_limit = detail->clock + insns * SAMPLE_MAX_CPI;
+    APEX_cpu_run(detail);
+
+    if (detail->halted || detail->insn_completed < detail->insn_limit)
+    {
+        return -1;
+    }
+
+    /* The run loop stops on its last cycle, the next run starts a new one */
+    detail->clock++;
+    return detail->clock - start_clock;
+}
+
+/*
+ * Samples one program. Windows are `period` instructions apart, each
+ * preceded by `warmup` detailed instructions that are not measured.
+ * Returns -1 if the program cannot be loaded or leaves code/data memory.
+ */
+int
+APEX_sample(const char *filename, const APEX_Config *config, long period,
+            int warmup, int window, FILE *out)
+{
+    APEX_CPU *func, *detail;
+    std::vector<double> cpi;
+    long total_insns = 0;
+    long skipped = 0;
+    double host_detail = 0;
+    int ret = 0;
+
+    if (period < warmup + window || window < 1)
+    {
+        fprintf(stderr, "APEX_Error: sample period must cover warmup + window\n");
+        return -1;
+    }
+
+    func = APEX_cpu_init(filename, config, TRUE);
+    detail = APEX_cpu_init(filename, config, TRUE);
+    if (!func || !detail)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize CPU for %s\n", filename);
+        if (func)
+        {
+            APEX_cpu_stop(func);
+        }
+        if (detail)
+        {
+            APEX_cpu_stop(detail);
+        }
+        return -1;
+    }
+
+    while (!func->halted)
+    {
+        long executed = APEX_functional_run(func, period - warmup - window, -1, TRUE);
+        long cycles;
+
+        if (executed < 0)
+        {
+            ret = -1;
+            break;
+        }
+        total_insns += executed;
+        if (func->halted)
+        {
+            break;
+        }
+
+        /* Detailed window from the current point, on a throwaway CPU */
+        if (APEX_functional_handoff(detail, func) != 0)
+        {
+            ret = -1;
+            break;
+        }
+        if (run_detail(detail, warmup) >= 0 && (cycles = run_detail(detail, window)) >= 0)
+        {
+            cpi.push_back((double)cycles / window);
+        }
+        else
+        {
+            skipped++;
+        }
+        host_detail += detail->host_seconds;
+        detail->host_seconds = 0;
+
+        /* The window's instructions still have to happen architecturally */
+        executed = APEX_functional_run(func, warmup + window, -1, TRUE);
+        if (executed < 0)
+        {
+            ret = -1;
+            break;
+        }
+        total_insns += executed;
+    }
+
+    if (ret == 0)
+    {
+        double mean = 0, var = 0, half = 0;
+        size_t n = cpi.size();
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            mean += cpi[i];
+        }
+        mean = n ? mean / n : 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            var += (cpi[i] - mean) * (cpi[i] - mean);
+        }
+        if (n > 1)
+        {
+            var /= n - 1;
+            half = t_quantile(n - 1) * sqrt(var / n);
+        }
+
+        fprintf(out, "APEX_Sample: %s\n", filename);
+        fprintf(out, "Instructions = %ld, period = %ld, warmup = %d, window = %d\n",
+                total_insns, period, warmup, window);
+        fprintf(out, "Samples = %zu (%ld abandoned)\n", n, skipped);
+        if (n)
+        {
+            fprintf(out, "CPI = %.4f +/- %.4f (95%% confidence)\n", mean, half);
+            fprintf(out, "Estimated cycles = %.0f +/- %.0f (%.2f%%)\n", mean * total_insns,
+                    half * total_insns, mean > 0 ? 100.0 * half / mean : 0.0);
+        }
+        else
+        {
+            fprintf(out, "No complete windows, program shorter than one period?\n");
+        }
+        fprintf(out, "Host time in detailed windows = %.3f s\n", host_detail);
+    }
+
+    APEX_cpu_stop(func);
+    APEX_cpu_stop(detail);
+    return ret;
+}
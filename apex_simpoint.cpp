@@ -0,0 +1,346 @@
+/*
+ * apex_simpoint.cpp
+ * Contains basic-block-vector profiling and SimPoint-style selection of
+ * representative intervals.
+ *
+ * The program runs on the functional interpreter and is cut into intervals
+ * of a fixed number of instructions. For each interval the profile counts
+ * the instructions executed in each basic block, where blocks start at the
+ * program entry, at conditional branch targets, after any branch, JUMP,
+ * JALR, RET or HALT, and wherever a taken control transfer lands. The
+ * normalized vectors are clustered with k-means, and the interval closest
+ * to each centroid represents its cluster, weighted by the share of
+ * instructions the cluster covers.
+ */
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#define KMEANS_MAX_ITERATIONS 100
+
+typedef struct Simpoint_Interval
+{
+    long start;              /* First instruction, counted from program start */
+    long length;             /* Instructions executed in the interval */
+    std::vector<double> bbv; /* Per block start index, normalized to sum 1 */
+    int cluster;
+} Simpoint_Interval;
+
+/* Static block leaders of the code image */
+static std::vector<char>
+find_leaders(const APEX_CPU *cpu)
+{
+    std::vector<char> leader(cpu->code_memory_size, FALSE);
+
+    leader[0] = TRUE;
+    for (int i = 0; i < cpu->code_memory_size; ++i)
+    {
+        const APEX_Instruction *ins = &cpu->code_memory[i];
+
+        if (!(ins->flags & (INSN_COND_BRANCH | INSN_INDIRECT)) && ins->opcode != OPCODE_HALT)
+        {
+            continue;
+        }
+        if (i + 1 < cpu->code_memory_size)
+        {
+            leader[i + 1] = TRUE;
+        }
+        if (ins->flags & INSN_COND_BRANCH)
+        {
+            int target = i + ins->imm / 4;
+
+            if (target >= 0 && target < cpu->code_memory_size)
+            {
+                leader[target] = TRUE;
+            }
+        }
+    }
+    return leader;
+}
+
+static void
+close_interval(std::vector<Simpoint_Interval> &intervals, std::vector<double> &counts,
+               long start, long length)
+{
+    Simpoint_Interval interval;
+
+    interval.start = start;
+    interval.length = length;
+    interval.cluster = 0;
+    interval.bbv = counts;
+    for (size_t b = 0; b < interval.bbv.size(); ++b)
+    {
+        interval.bbv[b] /= length;
+    }
+    intervals.push_back(interval);
+    std::fill(counts.begin(), counts.end(), 0.0);
+}
+
+/* Profiles the whole program; returns -1 if it leaves code/data memory */
+static int
+profile(APEX_CPU *func, long interval_length, std::vector<Simpoint_Interval> &intervals)
+{
+    std::vector<char> leader = find_leaders(func);
+    std::vector<double> counts(func->code_memory_size, 0.0);
+    long executed = 0, interval_start = 0;
+    int block = 0;
+    int transfer = TRUE;
+
+    while (!func->halted)
+    {
+        int index = (func->pc - 4000) / 4;
+        int expected_next = func->pc + 4;
+
+        if (index >= 0 && index < func->code_memory_size && (transfer || leader[index]))
+        {
+            block = index;
+        }
+        if (APEX_functional_run(func, 1, -1, FALSE) < 0)
+        {
+            return -1;
+        }
+        transfer = (func->pc != expected_next);
+
+        counts[block] += 1;
+        executed++;
+        if (executed - interval_start == interval_length)
+        {
+            close_interval(intervals, counts, interval_start, interval_length);
+            interval_start = executed;
+        }
+    }
+
+    /* A trailing partial interval still counts, weighted by its length */
+    if (executed > interval_start)
+    {
+        close_interval(intervals, counts, interval_start, executed - interval_start);
+    }
+    return 0;
+}
+
+static double
+distance2(const std::vector<double> &a, const std::vector<double> &b)
+{
+    double d = 0;
+
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        d += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+    return d;
+}
+
+/* Deterministic k-means++ seeding so runs are reproducible */
+static std::vector<std::vector<double> >
+seed_centroids(const std::vector<Simpoint_Interval> &intervals, int k)
+{
+    std::vector<std::vector<double> > centroids;
+    std::vector<double> nearest(intervals.size(), DBL_MAX);
+    unsigned int rng = 12345;
+
+    centroids.push_back(intervals[0].bbv);
+    while ((int)centroids.size() < k)
+    {
+        double total = 0, pick;
+        size_t chosen = 0;
+
+        for (size_t i = 0; i < intervals.size(); ++i)
+        {
+            nearest[i] = std::min(nearest[i], distance2(intervals[i].bbv, centroids.back()));
+            total += nearest[i];
+        }
+        if (total == 0)
+        {
+            break; /* Fewer distinct vectors than k */
+        }
+
+        rng = rng * 1103515245u + 12345u;
+        pick = total * ((rng >> 8) & 0xffff) / 65536.0;
+        for (chosen = 0; chosen + 1 < intervals.size(); ++chosen)
+        {
+            pick -= nearest[chosen];
+            if (pick < 0)
+            {
+                break;
+            }
+        }
+        centroids.push_back(intervals[chosen].bbv);
+    }
+    return centroids;
+}
+
+static void
+kmeans(std::vector<Simpoint_Interval> &intervals, std::vector<std::vector<double> > &centroids)
+{
+    size_t dims = intervals[0].bbv.size();
+
+    for (int iter = 0; iter < KMEANS_MAX_ITERATIONS; ++iter)
+    {
+        std::vector<std::vector<double> > sums(centroids.size(), std::vector<double>(dims, 0.0));
+        std::vector<long> members(centroids.size(), 0);
+        int changed = (iter == 0);
+
+        for (size_t i = 0; i < intervals.size(); ++i)
+        {
+            int best = 0;
+            double best_d = DBL_MAX;
+
+            for (size_t c = 0; c < centroids.size(); ++c)
+            {
+                double d = distance2(intervals[i].bbv, centroids[c]);
+
+                if (d < best_d)
+                {
+                    best_d = d;
+                    best = c;
+                }
+            }
+            if (intervals[i].cluster != best)
+            {
+                intervals[i].cluster = best;
+                changed = TRUE;
+            }
+            members[best]++;
+            for (size_t b = 0; b < dims; ++b)
+            {
+                sums[best][b] += intervals[i].bbv[b];
+            }
+        }
+
+        if (!changed)
+        {
+            break;
+        }
+        for (size_t c = 0; c < centroids.size(); ++c)
+        {
+            if (members[c])
+            {
+                for (size_t b = 0; b < dims; ++b)
+                {
+                    centroids[c][b] = sums[c][b] / members[c];
+                }
+            }
+        }
+    }
+}
+
+/* Functionally runs a fresh CPU to `start` and saves a detailed checkpoint there */
+static int
+write_checkpoint(const char *filename, const APEX_Config *config, long start,
+                 const char *path)
+{
+    APEX_CPU *func = APEX_cpu_init(filename, config, TRUE);
+    APEX_CPU *detail = APEX_cpu_init(filename, config, TRUE);
+    int ret = -1;
+
+    if (func && detail && APEX_functional_run(func, start, -1, TRUE) == start &&
+        APEX_functional_handoff(detail, func) == 0)
+    {
+        detail->ffwd_insns = start;
+        ret = APEX_checkpoint_write(detail, path);
+    }
+
+    if (func)
+    {
+        APEX_cpu_stop(func);
+    }
+    if (detail)
+    {
+        APEX_cpu_stop(detail);
+    }
+    return ret;
+}
+
+/*
+ * Profiles the program in intervals of `interval` instructions, clusters
+ * them into at most max_k groups and prints one representative per group.
+ * With checkpoint_prefix set, also writes <prefix>.<interval>.ckpt at the
+ * start of each representative for --checkpoint-in.
+ */
+int
+APEX_simpoint(const char *filename, const APEX_Config *config, long interval,
+              int max_k, const char *checkpoint_prefix, FILE *out)
+{
+    std::vector<Simpoint_Interval> intervals;
+    std::vector<std::vector<double> > centroids;
+    APEX_CPU *func;
+    long total = 0;
+    int ret = 0;
+
+    if (interval < 1 || max_k < 1)
+    {
+        fprintf(stderr, "APEX_Error: simpoint interval and k must be positive\n");
+        return -1;
+    }
+
+    func = APEX_cpu_init(filename, config, TRUE);
+    if (!func)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize CPU for %s\n", filename);
+        return -1;
+    }
+    ret = profile(func, interval, intervals);
+    APEX_cpu_stop(func);
+    if (ret != 0 || intervals.empty())
+    {
+        return -1;
+    }
+
+    centroids = seed_centroids(intervals, std::min<size_t>(max_k, intervals.size()));
+    kmeans(intervals, centroids);
+
+    for (size_t i = 0; i < intervals.size(); ++i)
+    {
+        total += intervals[i].length;
+    }
+
+    fprintf(out, "APEX_Simpoint: %s\n", filename);
+    fprintf(out, "Instructions = %ld, interval = %ld, intervals = %zu, clusters = %zu\n",
+            total, interval, intervals.size(), centroids.size());
+    fprintf(out, "%-9s %-12s %-9s %s\n", "interval", "start_insn", "weight", "checkpoint");
+
+    for (size_t c = 0; c < centroids.size(); ++c)
+    {
+        long covered = 0;
+        size_t best = intervals.size();
+        double best_d = DBL_MAX;
+        char path[1024] = "-";
+
+        for (size_t i = 0; i < intervals.size(); ++i)
+        {
+            if (intervals[i].cluster != (int)c)
+            {
+                continue;
+            }
+            covered += intervals[i].length;
+            if (distance2(intervals[i].bbv, centroids[c]) < best_d)
+            {
+                best_d = distance2(intervals[i].bbv, centroids[c]);
+                best = i;
+            }
+        }
+        if (best == intervals.size())
+        {
+            continue; /* Empty cluster */
+        }
+
+        if (checkpoint_prefix)
+        {
+            snprintf(path, sizeof(path), "%s.%zu.ckpt", checkpoint_prefix, best);
+            if (write_checkpoint(filename, config, intervals[best].start, path) != 0)
+            {
+                ret = -1;
+            }
+        }
+        fprintf(out, "%-9zu %-12ld %-9.4f %s\n", best, intervals[best].start,
+                (double)covered / total, path);
+    }
+
+    return ret;
+}
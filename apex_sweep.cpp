@@ -0,0 +1,210 @@
+/*
+ * apex_sweep.cpp
+ * Contains the design-space sweep driver: runs every program at every point
+ * of a parameter grid, one independent APEX_CPU per point, on a pool of
+ * threads, and writes one CSV row per point.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* One grid axis: a config key and the values to try for it */
+typedef struct Sweep_Axis
+{
+    std::string key;
+    std::vector<std::string> values;
+} Sweep_Axis;
+
+/*
+ * Reads the grid file. Same format as a config file except each value may
+ * be a comma separated list, e.g. "iq_size = 8,16,32". Returns -1 on error.
+ */
+static int
+load_grid(const char *grid_file, const APEX_Config *base, std::vector<Sweep_Axis> &axes)
+{
+    FILE *fp;
+    char line[1024];
+    int line_num = 0;
+    int ret = 0;
+
+    fp = fopen(grid_file, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open sweep grid %s\n", grid_file);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        char *comment = strchr(line, '#');
+        char *eq, *save, *token;
+        char key[64];
+        Sweep_Axis axis;
+
+        line_num++;
+        if (comment)
+        {
+            *comment = '\0';
+        }
+        if (sscanf(line, " %63[^= \t]", key) != 1)
+        {
+            continue;
+        }
+
+        eq = strchr(line, '=');
+        if (!eq)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: expected key = v1,v2,...\n", grid_file, line_num);
+            ret = -1;
+            continue;
+        }
+
+        axis.key = key;
+        for (token = strtok_r(eq + 1, ", \t\r\n", &save); token;
+             token = strtok_r(NULL, ", \t\r\n", &save))
+        {
+            APEX_Config check = *base;
+
+            if (APEX_config_set(&check, key, token) != 0)
+            {
+                fprintf(stderr, "APEX_Error: %s:%d: bad setting %s = %s\n", grid_file,
+                        line_num, key, token);
+                ret = -1;
+                continue;
+            }
+            axis.values.push_back(token);
+        }
+
+        if (!axis.values.empty())
+        {
+            axes.push_back(axis);
+        }
+    }
+
+    fclose(fp);
+    return ret;
+}
+
+/*
+ * Runs programs x grid points on the given number of threads. Each CPU is
+ * fully independent, so threads only share the work counter and the output
+ * stream. Rows are written as points finish; the first column is the point
+ * number so the table can be sorted back into grid order.
+ */
+int
+APEX_sweep(const char *grid_file, const APEX_Config *base,
+           const std::vector<std::string> &programs, int threads,
+           int cycle_limit, FILE *out)
+{
+    std::vector<Sweep_Axis> axes;
+    std::vector<APEX_Config> grid;
+    std::atomic<size_t> next(0);
+    std::atomic<int> failures(0);
+    std::mutex out_lock;
+    std::vector<std::thread> pool;
+    size_t num_points;
+
+    if (load_grid(grid_file, base, axes) != 0)
+    {
+        return -1;
+    }
+
+    /* Cartesian product of all axes, applied on top of the base config */
+    grid.push_back(*base);
+    for (size_t a = 0; a < axes.size(); ++a)
+    {
+        std::vector<APEX_Config> expanded;
+
+        for (size_t g = 0; g < grid.size(); ++g)
+        {
+            for (size_t v = 0; v < axes[a].values.size(); ++v)
+            {
+                APEX_Config config = grid[g];
+
+                APEX_config_set(&config, axes[a].key.c_str(), axes[a].values[v].c_str());
+                expanded.push_back(config);
+            }
+        }
+        grid.swap(expanded);
+    }
+
+    for (size_t g = 0; g < grid.size(); ++g)
+    {
+        if (APEX_config_validate(&grid[g]) != 0)
+        {
+            return -1;
+        }
+    }
+
+    num_points = grid.size() * programs.size();
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    if ((size_t)threads > num_points)
+    {
+        threads = num_points;
+    }
+
+    fprintf(out, "point,program,");
+    APEX_config_csv_header(out);
+    fprintf(out, ",cycles,instructions,ipc,commit_width_limited,commit_head_incomplete,"
+                 "branches,mispredicts,flush_cycles,halted,host_seconds\n");
+
+    for (int t = 0; t < threads; ++t)
+    {
+        pool.push_back(std::thread([&]() {
+            size_t point;
+
+            while ((point = next++) < num_points)
+            {
+                const std::string &program = programs[point % programs.size()];
+                const APEX_Config &config = grid[point / programs.size()];
+                APEX_CPU *cpu = APEX_cpu_init(program.c_str(), &config, TRUE);
+
+                if (!cpu)
+                {
+                    std::lock_guard<std::mutex> guard(out_lock);
+                    fprintf(stderr, "APEX_Error: Unable to initialize CPU for %s\n",
+                            program.c_str());
+                    failures++;
+                    continue;
+                }
+
+                cpu->cycle_limit = cycle_limit;
+                APEX_cpu_run(cpu);
+
+                {
+                    std::lock_guard<std::mutex> guard(out_lock);
+
+                    fprintf(out, "%zu,%s,", point, program.c_str());
+                    APEX_config_csv_row(&config, out);
+                    fprintf(out, ",%d,%d,%.4f,%ld,%ld,%ld,%ld,%ld,%d,%.6f\n", cpu->clock,
+                            cpu->insn_completed,
+                            cpu->clock ? (double)cpu->insn_completed / cpu->clock : 0.0,
+                            cpu->commit_stats.width_limited, cpu->commit_stats.head_incomplete,
+                            cpu->branch_stats.resolved, cpu->branch_stats.mispredicted,
+                            cpu->branch_stats.flush_cycles, cpu->halted, cpu->host_seconds);
+                }
+
+                APEX_cpu_stop(cpu);
+            }
+        }));
+    }
+
+    for (size_t t = 0; t < pool.size(); ++t)
+    {
+        pool[t].join();
+    }
+    fflush(out);
+
+    return failures ? -1 : 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * apex_trace.cpp
+ * Contains APEX cpu pipeline trace ring buffer
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_trace.h"
+
+int
+trace_init(APEX_Trace *trace, unsigned int mask, int level, size_t size)
+{
+    trace->mask = mask;
+    trace->level = level;
+    trace->buffer = NULL;
+    trace->size = 0;
+    trace->start = 0;
+    trace->len = 0;
+    trace->sink = stdout;
+
+    /* Nothing will ever be recorded, don't bother allocating */
+    if (level == TRACE_LEVEL_OFF || mask == 0 || size == 0)
+    {
+        trace->level = TRACE_LEVEL_OFF;
+        return 0;
+    }
+
+    trace->buffer = (char *)malloc(size);
+    if (!trace->buffer)
+    {
+        trace->level = TRACE_LEVEL_OFF;
+        return -1;
+    }
+    trace->size = size;
+    return 0;
+}
+
+/* Appends to the ring, dropping the oldest bytes once it is full */
+static void
+trace_append(APEX_Trace *trace, const char *data, size_t n)
+{
+    size_t pos, first;
+
+    if (n > trace->size)
+    {
+        data += n - trace->size;
+        n = trace->size;
+    }
+
+    pos = (trace->start + trace->len) % trace->size;
+    first = trace->size - pos;
+    if (first > n)
+    {
+        first = n;
+    }
+    memcpy(trace->buffer + pos, data, first);
+    memcpy(trace->buffer, data + first, n - first);
+
+    trace->len += n;
+    if (trace->len > trace->size)
+    {
+        trace->start = (trace->start + trace->len - trace->size) % trace->size;
+        trace->len = trace->size;
+    }
+}
+
+void
+trace_printf(APEX_Trace *trace, const char *fmt, ...)
+{
+    char line[256];
+    va_list args;
+    int n;
+
+    if (!trace->buffer)
+    {
+        return;
+    }
+
+    va_start(args, fmt);
+    n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    if (n < 0)
+    {
+        return;
+    }
+    if ((size_t)n >= sizeof(line))
+    {
+        n = sizeof(line) - 1;
+    }
+    trace_append(trace, line, n);
+}
+
+void
+trace_flush(APEX_Trace *trace)
+{
+    size_t first;
+
+    if (!trace->buffer || trace->len == 0)
+    {
+        return;
+    }
+
+    first = trace->size - trace->start;
+    if (first > trace->len)
+    {
+        first = trace->len;
+    }
+    fwrite(trace->buffer + trace->start, 1, first, trace->sink);
+    fwrite(trace->buffer, 1, trace->len - first, trace->sink);
+
+    trace->start = 0;
+    trace->len = 0;
+}
+
+/* Releases the buffer and closes a sink other than stdout */
+void
+trace_free(APEX_Trace *trace)
+{
+    free(trace->buffer);
+    trace->buffer = NULL;
+    trace->level = TRACE_LEVEL_OFF;
+    if (trace->sink && trace->sink != stdout)
+    {
+        fclose(trace->sink);
+    }
+    trace->sink = stdout;
+}
+
+/*
+ * Parses a comma separated category list, e.g. "fetch,exec,commit" or "all".
+ * Unknown names are ignored.
+ */
+unsigned int
+trace_parse_categories(const char *list)
+{
+    static const struct
+    {
+        const char *name;
+        unsigned int mask;
+    } categories[] = {
+        {"cycle", TRACE_CYCLE},   {"fetch", TRACE_FETCH},
+        {"decode", TRACE_DECODE}, {"issue", TRACE_ISSUE},
+        {"exec", TRACE_EXEC},     {"mem", TRACE_MEM},
+        {"wb", TRACE_WB},         {"commit", TRACE_COMMIT},
+        {"all", TRACE_ALL},
+    };
+    unsigned int mask = 0;
+    const char *p = list;
+
+    while (*p)
+    {
+        size_t n = strcspn(p, ",");
+
+        for (size_t i = 0; i < sizeof(categories) / sizeof(categories[0]); ++i)
+        {
+            if (strlen(categories[i].name) == n &&
+                strncmp(categories[i].name, p, n) == 0)
+            {
+                mask |= categories[i].mask;
+            }
+        }
+
+        p += n;
+        if (*p == ',')
+        {
+            p++;
+        }
+    }
+    return mask;
+}
@@ -0,0 +1,71 @@
+/*
+ * apex_trace.h
+ * Contains APEX cpu pipeline trace declarations
+ *
+ * Trace points are grouped into per-stage categories and levels. With
+ * APEX_TRACE_LEVEL set to 0 at compile time every trace point compiles away.
+ * Otherwise the messages are formatted into a per-CPU ring buffer that is
+ * written out in one go (every cycle in interactive runs, at the end of a
+ * batch run) instead of one stdout call per message.
+ */
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Trace categories */
+#define TRACE_CYCLE  0x01
+#define TRACE_FETCH  0x02
+#define TRACE_DECODE 0x04
+#define TRACE_ISSUE  0x08
+#define TRACE_EXEC   0x10
+#define TRACE_MEM    0x20
+#define TRACE_WB     0x40
+#define TRACE_COMMIT 0x80
+#define TRACE_ALL    0xff
+
+/* Trace levels */
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_STAGE 1  /* One line per stage per cycle */
+#define TRACE_LEVEL_DETAIL 2 /* Individual events: issue, wakeup, flush */
+
+/* Highest level compiled in, override with -DAPEX_TRACE_LEVEL=<n> */
+#ifndef APEX_TRACE_LEVEL
+#define APEX_TRACE_LEVEL TRACE_LEVEL_DETAIL
+#endif
+
+#define TRACE_DEFAULT_BUFFER_SIZE (64 * 1024)
+
+typedef struct APEX_Trace
+{
+    unsigned int mask; /* Enabled categories */
+    int level;         /* Enabled level, TRACE_LEVEL_OFF disables all */
+    char *buffer;      /* Ring of formatted messages */
+    size_t size;
+    size_t start;      /* Oldest byte still in the ring */
+    size_t len;
+    FILE *sink;        /* Where trace_flush() writes, stdout by default */
+} APEX_Trace;
+
+#if APEX_TRACE_LEVEL > 0
+#define APEX_TRACE(cpu, cat, lvl, ...)                                        \
+    do                                                                        \
+    {                                                                         \
+        if ((lvl) <= APEX_TRACE_LEVEL && (lvl) <= (cpu)->trace.level &&       \
+            ((cpu)->trace.mask & (cat)))                                      \
+        {                                                                     \
+            trace_printf(&(cpu)->trace, __VA_ARGS__);                         \
+        }                                                                     \
+    } while (0)
+#else
+#define APEX_TRACE(cpu, cat, lvl, ...) do { } while (0)
+#endif
+
+int trace_init(APEX_Trace *trace, unsigned int mask, int level, size_t size);
+void trace_printf(APEX_Trace *trace, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void trace_flush(APEX_Trace *trace);
+void trace_free(APEX_Trace *trace);
+unsigned int trace_parse_categories(const char *list);
+#endif
@@ -37,120 +37,75 @@ get_num_from_string(const char *buffer)
 }
 
 /*
- * This function sets the numeric opcode to an instruction based on string value
+ * Everything about an opcode that does not depend on its operands, indexed
+ * by opcode. create_APEX_instruction() copies it into each instruction once
+ * so the pipeline never has to switch on the opcode to classify it.
  *
- * Note : you can edit this function to add new instructions
+ * Note : you can edit this table to add new instructions
  */
-static int
-set_opcode_str(const char *opcode_str)
+typedef struct Opcode_Info
 {
-    if (strcmp(opcode_str, "ADD") == 0)
-    {
-        return OPCODE_ADD;
-    }
-
-    if (strcmp(opcode_str, "SUB") == 0)
-    {
-        return OPCODE_SUB;
-    }
-
-    if (strcmp(opcode_str, "MUL") == 0)
-    {
-        return OPCODE_MUL;
-    }
-
-    if (strcmp(opcode_str, "DIV") == 0)
-    {
-        return OPCODE_DIV;
-    }
-
-    if (strcmp(opcode_str, "AND") == 0)
-    {
-        return OPCODE_AND;
-    }
-
-    if (strcmp(opcode_str, "OR") == 0)
-    {
-        return OPCODE_OR;
-    }
-
-    if (strcmp(opcode_str, "EXOR") == 0)
-    {
-        return OPCODE_EXOR;
-    }
-
-    if (strcmp(opcode_str, "MOVC") == 0)
-    {
-        return OPCODE_MOVC;
-    }
-
-    if (strcmp(opcode_str, "LOAD") == 0)
-    {
-        return OPCODE_LOAD;
-    }
-
-    if (strcmp(opcode_str, "STORE") == 0)
-    {
-        return OPCODE_STORE;
-    }
-
-    if (strcmp(opcode_str, "BZ") == 0)
-    {
-        return OPCODE_BZ;
-    }
-
-    if (strcmp(opcode_str, "BNZ") == 0)
-    {
-        return OPCODE_BNZ;
-    }
-
-    if (strcmp(opcode_str, "HALT") == 0)
-    {
-        return OPCODE_HALT;
-    }
-
-    if (strcmp(opcode_str, "BP") == 0)
-    {
-        return OPCODE_BP;
-    }
-
-    if (strcmp(opcode_str, "BNP") == 0)
-    {
-        return OPCODE_BNP;
-    }
-
-    if (strcmp(opcode_str, "ADDL") == 0)
-    {
-        return OPCODE_ADDL;
-    }
-
-    if (strcmp(opcode_str, "NOP") == 0)
-    {
-        return OPCODE_NOP;
-    }
-
-    if (strcmp(opcode_str, "SUBL") == 0)
-    {
-        return OPCODE_SUBL;
-    }
-
-    if (strcmp(opcode_str, "CMP") == 0)
-    {
-        return OPCODE_CMP;
-    }
-
-    if (strcmp(opcode_str, "JUMP") == 0)
+    const char *name;
+    int8_t vfu;
+    uint8_t flags;
+    uint8_t latency;
+} Opcode_Info;
+
+#define RRR (INSN_HAS_RD | INSN_HAS_RS1 | INSN_HAS_RS2)
+#define RRI (INSN_HAS_RD | INSN_HAS_RS1 | INSN_HAS_IMM)
+
+static const Opcode_Info opcode_info[NUM_OPCODES] = {
+    /* name    vfu         flags                                                 latency */
+    {"ADD",   INT_VFU,    RRR | INSN_SETS_FLAGS,                                 1},
+    {"SUB",   INT_VFU,    RRR | INSN_SETS_FLAGS,                                 1},
+    {"MUL",   MUL_VFU,    RRR | INSN_SETS_FLAGS,                                 3},
+    {"DIV",   INT_VFU,    RRR,                                                   1},
+    {"AND",   INT_VFU,    RRR | INSN_SETS_FLAGS,                                 1},
+    {"OR",    INT_VFU,    RRR | INSN_SETS_FLAGS,                                 1},
+    {"EXOR",  INT_VFU,    RRR | INSN_SETS_FLAGS,                                 1},
+    {"MOVC",  INT_VFU,    INSN_HAS_RD | INSN_HAS_IMM | INSN_SETS_FLAGS,          1},
+    {"LOAD",  INT_VFU,    RRI | INSN_MEM,                                        2},
+    {"STORE", INT_VFU,    INSN_HAS_RS1 | INSN_HAS_RS2 | INSN_HAS_IMM | INSN_MEM, 2},
+    {"BZ",    BRANCH_VFU, INSN_HAS_IMM | INSN_COND_BRANCH,                       1},
+    {"BNZ",   BRANCH_VFU, INSN_HAS_IMM | INSN_COND_BRANCH,                       1},
+    {"HALT",  BRANCH_VFU, 0,                                                     1},
+    {"BP",    BRANCH_VFU, INSN_HAS_IMM | INSN_COND_BRANCH,                       1},
+    {"BNP",   BRANCH_VFU, INSN_HAS_IMM | INSN_COND_BRANCH,                       1},
+    {"ADDL",  INT_VFU,    RRI | INSN_SETS_FLAGS,                                 1},
+    {"NOP",   INT_VFU,    0,                                                     1},
+    {"SUBL",  INT_VFU,    RRI | INSN_SETS_FLAGS,                                 1},
+    {"CMP",   INT_VFU,    INSN_HAS_RS1 | INSN_HAS_RS2 | INSN_SETS_FLAGS,         1},
+    {"JUMP",  BRANCH_VFU, INSN_HAS_RS1 | INSN_HAS_IMM | INSN_INDIRECT,           1},
+    {"JALR",  BRANCH_VFU, RRI | INSN_INDIRECT,                                   1},
+    {"RET",   BRANCH_VFU, INSN_HAS_RS1 | INSN_INDIRECT,                          1},
+};
+
+#undef RRR
+#undef RRI
+
+/* Mnemonic for display; the pipeline itself only carries the opcode */
+const char *
+APEX_opcode_name(int opcode)
+{
+    if (opcode < 0 || opcode >= NUM_OPCODES)
     {
-        return OPCODE_JUMP;
+        return "???";
     }
+    return opcode_info[opcode].name;
+}
 
-    if (strcmp(opcode_str, "JALR") == 0)
-    {
-        return OPCODE_JALR;
-    }
-    if (strcmp(opcode_str, "RET") == 0)
+/*
+ * This function sets the numeric opcode to an instruction based on string value
+ */
+static int
+set_opcode_str(const char *opcode_str)
+{
+    for (int i = 0; i < NUM_OPCODES; ++i)
     {
-        return OPCODE_RET;
+        if (strcmp(opcode_str, opcode_info[i].name) == 0)
+        {
+            return i;
+        }
     }
 
     assert(0 && "Invalid opcode");
@@ -161,14 +116,15 @@ static void
 split_opcode_from_insn_string(char *buffer, char tokens[2][128])
 {
     int token_num = 0;
+    char *save;
 
-    char *token = strtok(buffer, " ");
+    char *token = strtok_r(buffer, " ", &save);
 
     while (token != NULL)
     {
         strcpy(tokens[token_num], token);
         token_num++;
-        token = strtok(NULL, " ");
+        token = strtok_r(NULL, " ", &save);
     }
 }
 
@@ -183,6 +139,7 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
     int i, token_num = 0;
     char tokens[6][128];
     char top_level_tokens[2][128];
+    char *save;
 
     for (i = 0; i < 2; ++i)
     {
@@ -191,17 +148,19 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
 
     split_opcode_from_insn_string(buffer, top_level_tokens);
 
-    char *token = strtok(top_level_tokens[1], ",");
+    char *token = strtok_r(top_level_tokens[1], ",", &save);
 
     while (token != NULL)
     {
         strcpy(tokens[token_num], token);
         token_num++;
-        token = strtok(NULL, ",");
+        token = strtok_r(NULL, ",", &save);
     }
 
-    strcpy(ins->opcode_str, top_level_tokens[0]);
-    ins->opcode = set_opcode_str(ins->opcode_str);
+    ins->opcode = set_opcode_str(top_level_tokens[0]);
+    ins->vfu = opcode_info[ins->opcode].vfu;
+    ins->flags = opcode_info[ins->opcode].flags;
+    ins->latency = opcode_info[ins->opcode].latency;
 
     switch (ins->opcode)
     {
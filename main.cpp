@@ -7,7 +7,9 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
+#include <thread>
 #include "apex_cpu.h"
 
 int
@@ -17,32 +19,330 @@ main(int argc, char const *argv[])
 
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", 2);
 
-    if (argc != 2)
+    const char *filename = NULL;
+    std::vector<std::string> programs;
+    const char *sweep_grid = NULL;
+    const char *sweep_out = NULL;
+    int threads = std::thread::hardware_concurrency();
+    int batch_mode = FALSE;
+    int cycle_limit = 0;
+    unsigned int trace_mask = 0;
+    int trace_level = TRACE_LEVEL_STAGE;
+    size_t trace_buffer = TRACE_DEFAULT_BUFFER_SIZE;
+    const char *trace_file = NULL;
+    long ffwd_insns = 0;
+    int ffwd_pc = -1;
+    int warm_btb = FALSE;
+    const char *checkpoint_in = NULL;
+    const char *checkpoint_out = NULL;
+    long sample_period = 0;
+    int sample_warmup = 200;
+    int sample_window = 100;
+    long simpoint_interval = 0;
+    int simpoint_k = 4;
+    const char *simpoint_ckpt = NULL;
+    int insn_limit = 0;
+    APEX_Config config;
+
+    APEX_config_default(&config);
+
+    for (int i = 1; i < argc; ++i)
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
-        exit(1);
+        if (strcmp(argv[i], "--batch") == 0)
+        {
+            batch_mode = TRUE;
+        }
+        else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+        {
+            cycle_limit = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--insns") == 0 && i + 1 < argc)
+        {
+            insn_limit = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+        {
+            if (APEX_config_load(&config, argv[++i]) != 0)
+            {
+                exit(1);
+            }
+        }
+        else if ((strcmp(argv[i], "--iq") == 0 || strcmp(argv[i], "--rob") == 0 ||
+                  strcmp(argv[i], "--lsq") == 0 || strcmp(argv[i], "--prf") == 0) &&
+                 i + 1 < argc)
+        {
+            static const char *keys[][2] = {
+                {"--iq", "iq_size"}, {"--rob", "rob_size"},
+                {"--lsq", "lsq_size"}, {"--prf", "phys_regs"},
+            };
+
+            for (int k = 0; k < 4; ++k)
+            {
+                if (strcmp(argv[i], keys[k][0]) == 0 &&
+                    APEX_config_set(&config, keys[k][1], argv[i + 1]) != 0)
+                {
+                    fprintf(stderr, "APEX_Error: bad value for %s\n", argv[i]);
+                    exit(1);
+                }
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--set") == 0 && i + 1 < argc)
+        {
+            char key[64];
+            const char *eq = strchr(argv[++i], '=');
+
+            if (!eq || eq - argv[i] >= (int)sizeof(key))
+            {
+                fprintf(stderr, "APEX_Error: --set expects key=value\n");
+                exit(1);
+            }
+            snprintf(key, sizeof(key), "%.*s", (int)(eq - argv[i]), argv[i]);
+            if (APEX_config_set(&config, key, eq + 1) != 0)
+            {
+                fprintf(stderr, "APEX_Error: bad config setting %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_mask = trace_parse_categories(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--trace-level") == 0 && i + 1 < argc)
+        {
+            trace_level = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--trace-buffer") == 0 && i + 1 < argc)
+        {
+            trace_buffer = strtoul(argv[++i], NULL, 10);
+            if (trace_buffer == 0)
+            {
+                fprintf(stderr, "APEX_Error: --trace-buffer needs at least one byte\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--trace-file") == 0 && i + 1 < argc)
+        {
+            trace_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--ffwd") == 0 && i + 1 < argc)
+        {
+            ffwd_insns = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ffwd-pc") == 0 && i + 1 < argc)
+        {
+            ffwd_pc = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--warm-btb") == 0)
+        {
+            warm_btb = TRUE;
+        }
+        else if (strcmp(argv[i], "--checkpoint-in") == 0 && i + 1 < argc)
+        {
+            checkpoint_in = argv[++i];
+        }
+        else if (strcmp(argv[i], "--checkpoint-out") == 0 && i + 1 < argc)
+        {
+            checkpoint_out = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc)
+        {
+            sample_period = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sample-warmup") == 0 && i + 1 < argc)
+        {
+            sample_warmup = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sample-window") == 0 && i + 1 < argc)
+        {
+            sample_window = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--simpoint") == 0 && i + 1 < argc)
+        {
+            simpoint_interval = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--simpoint-k") == 0 && i + 1 < argc)
+        {
+            simpoint_k = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--simpoint-ckpt") == 0 && i + 1 < argc)
+        {
+            simpoint_ckpt = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc)
+        {
+            sweep_grid = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            sweep_out = argv[++i];
+        }
+        else if (argv[i][0] != '-')
+        {
+            programs.push_back(argv[i]);
+        }
+        else
+        {
+            programs.clear();
+            break;
+        }
     }
 
-    std::string user_input;
+    if (sweep_grid && !programs.empty())
+    {
+        FILE *out = stdout;
+        int ret;
 
-    std::cout <<"Enter a command: " << std::endl;
-    getline(std::cin, user_input);
-    if (user_input == "")
+        if (APEX_config_validate(&config) != 0)
+        {
+            exit(1);
+        }
+        if (sweep_out && !(out = fopen(sweep_out, "w")))
+        {
+            fprintf(stderr, "APEX_Error: Unable to open %s\n", sweep_out);
+            exit(1);
+        }
+
+        ret = APEX_sweep(sweep_grid, &config, programs, threads, cycle_limit, out);
+        if (out != stdout)
+        {
+            fclose(out);
+        }
+        return ret ? 1 : 0;
+    }
+
+    if (programs.size() == 1)
     {
-        printf("HUH");
-        user_input = " ";
+        filename = programs[0].c_str();
     }
 
-    cpu = APEX_cpu_init(argv[1]);
-   APEX_command(cpu, user_input);
+    if (!filename)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> [--batch] [--cycles <n>] [--insns <n>]\n"
+                "          [--config <file>] [--iq <n>] [--rob <n>] [--lsq <n>] [--prf <n>]\n"
+                "          [--set <key>=<value>]\n"
+                "          [--trace <fetch,decode,issue,exec,mem,wb,commit,cycle|all>]\n"
+                "          [--trace-level <n>] [--trace-buffer <bytes>] [--trace-file <file>]\n"
+                "          [--ffwd <n>] [--ffwd-pc <pc>] [--warm-btb]\n"
+                "          [--checkpoint-in <file>] [--checkpoint-out <file>]\n"
+                "       %s --sample <period> [--sample-warmup <n>] [--sample-window <n>]\n"
+                "          [--config <file>] <input_file>\n"
+                "       %s --simpoint <interval> [--simpoint-k <k>] [--simpoint-ckpt <prefix>]\n"
+                "          [--config <file>] <input_file>\n"
+                "       %s --sweep <grid_file> [--threads <n>] [--out <csv>] [--cycles <n>]\n"
+                "          [--config <file>] <input_file>...\n",
+                argv[0], argv[0], argv[0], argv[0]);
+        exit(1);
+    }
+
+    if (APEX_config_validate(&config) != 0)
+    {
+        exit(1);
+    }
+
+    /* Sampled runs build their own CPUs and only print the estimate */
+    if (sample_period > 0)
+    {
+        return APEX_sample(filename, &config, sample_period, sample_warmup,
+                           sample_window, stdout) ? 1 : 0;
+    }
+    if (simpoint_interval > 0)
+    {
+        return APEX_simpoint(filename, &config, simpoint_interval, simpoint_k,
+                             simpoint_ckpt, stdout) ? 1 : 0;
+    }
 
+    cpu = APEX_cpu_init(filename, &config, batch_mode);
     if (!cpu)
     {
         fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
         exit(1);
     }
+    cpu->cycle_limit = cycle_limit;
+    cpu->insn_limit = insn_limit;
 
-    APEX_cpu_run(cpu);
+    /* Resume a saved state; --cycles and --insns then count from the checkpoint */
+    if (checkpoint_in)
+    {
+        if (APEX_checkpoint_read(cpu, checkpoint_in) != 0)
+        {
+            exit(1);
+        }
+        if (cycle_limit > 0)
+        {
+            cpu->cycle_limit = cpu->clock + cycle_limit - 1;
+        }
+        if (insn_limit > 0)
+        {
+            cpu->insn_limit = cpu->insn_completed + insn_limit;
+        }
+    }
+    /* Run the prefix architecturally, then switch to the detailed model */
+    else if (ffwd_insns > 0 || ffwd_pc >= 0)
+    {
+        if (APEX_functional_run(cpu, ffwd_insns > 0 ? ffwd_insns : LONG_MAX, ffwd_pc,
+                                warm_btb) < 0 ||
+            APEX_cpu_switch_over(cpu) != 0)
+        {
+            exit(1);
+        }
+    }
+
+    if (trace_mask)
+    {
+        FILE *sink = NULL;
+
+        if (trace_file && !(sink = fopen(trace_file, "w")))
+        {
+            fprintf(stderr, "APEX_Error: Unable to open trace file %s\n", trace_file);
+            exit(1);
+        }
+        APEX_cpu_set_trace(cpu, trace_mask, trace_level, trace_buffer, sink);
+    }
+
+    /* Batch runs are non-interactive: no prompt, no per-cycle commands */
+    if (!batch_mode)
+    {
+        std::string user_input;
+
+        std::cout <<"Enter a command: " << std::endl;
+        getline(std::cin, user_input);
+        if (user_input == "")
+        {
+            printf("HUH");
+            user_input = " ";
+        }
+
+        APEX_command(cpu, user_input);
+    }
+
+    /* STOP at the first prompt ends the run before it starts, and there is
+     * nothing left to simulate if fast forward reached HALT */
+    if (!cpu->stop_requested && !cpu->halted)
+    {
+        APEX_cpu_run(cpu);
+    }
+    if (batch_mode)
+    {
+        APEX_cpu_print_summary(cpu);
+    }
+    if (checkpoint_out)
+    {
+        /* The run loop stops on its last simulated cycle without advancing
+         * the clock; the checkpoint resumes at the next one */
+        if (!cpu->halted)
+        {
+            cpu->clock++;
+        }
+        if (APEX_checkpoint_write(cpu, checkpoint_out) != 0)
+        {
+            exit(1);
+        }
+    }
     APEX_cpu_stop(cpu);
     return 0;
 }